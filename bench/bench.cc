@@ -0,0 +1,489 @@
+/* Copyright (C) 2024  Bogdan-Gabriel Alecu  (GameInstance.com)
+ *
+ * FLAC decoder - part of audio package
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <numbers>
+#include <random>
+#include <vector>
+#include <basics/error.hh>
+#include "bit.hh"
+#include "buffer.hh"
+#include "crc.hh"
+#include "flac.hh"
+#include "lpc.hh"
+#include "md5.hh"
+#include "memory.hh"
+#include "pcm.hh"
+#include "wave.hh"
+
+using namespace basics;
+using namespace audio;
+
+
+/*******************************************************************************************************
+ *
+ * Codec micro-benchmarks and end-to-end decode benchmarks on synthetic data. Every case is timed over
+ * enough repetitions to run for about min_seconds, best of repeat_count runs, and reported as the
+ * bytes and samples it processes per second: the coded bytes for bit reading, CRC and MD5, the PCM
+ * bytes for packing and WAVE encoding, and 4-byte samples for LPC restoration. Decode benchmarks
+ * report the FLAC stream bytes read per second.
+ *
+ */
+
+
+struct byte_ostream {  // output stream into memory
+	std::vector<std::byte> data;
+
+	void put(char value) { data.push_back((std::byte)value); }
+	void write(const char *values, size_t size) {
+		data.insert(data.end(), (const std::byte *)values, (const std::byte *)values + size);
+	}
+	void flush() {}
+};
+
+
+static const double min_seconds = 0.05;
+static const size_t repeat_count = 3;
+static const size_t block_size = 4096;
+
+
+template<typename JOB>
+double measure(JOB &&job);
+void report(const char *name, double seconds, size_t byte_size, size_t sample_count);
+std::vector<int32_t> make_signal(size_t size, uint8_t channel_count, uint8_t sample_bit_size,
+																						uint32_t seed);
+void bench_rice();
+void bench_verbatim();
+void bench_lpc();
+void bench_pcm();
+void bench_wave();
+void bench_checksums();
+void bench_decode();
+void bench_batch();
+
+
+int main()
+{
+	try {
+		printf("%-44s %10s %12s\n", "benchmark", "MB/s", "Msamples/s");
+		bench_rice();
+		bench_verbatim();
+		bench_lpc();
+		bench_pcm();
+		bench_wave();
+		bench_checksums();
+		bench_decode();
+		bench_batch();
+	} catch (const error &err) {
+		err.dump();
+
+		return 1;
+	}
+
+	return 0;
+}
+
+
+template<typename JOB>
+double measure(JOB &&job)
+{   // seconds per call, the best of repeat_count runs
+	size_t call_count{1};
+	for (;;) {  // calibrate
+		const auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < call_count; ++i)
+			job();
+		const auto elapsed = std::chrono::steady_clock::now() - start;
+		const auto seconds = std::chrono::duration<double>(elapsed).count();
+		if (seconds >= min_seconds)
+			break;
+		call_count *= 2;
+	}
+
+	auto res = HUGE_VAL;
+	for (size_t run = 0; run < repeat_count; ++run) {
+		const auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < call_count; ++i)
+			job();
+		const auto elapsed = std::chrono::steady_clock::now() - start;
+		const auto seconds = std::chrono::duration<double>(elapsed).count();
+		res = std::min(res, seconds / call_count);
+	}
+
+	return res;
+}
+
+
+void report(const char *name, double seconds, size_t byte_size, size_t sample_count)
+{
+	printf("%-44s %10.1f %12.1f\n", name, byte_size / seconds / 1e6, sample_count / seconds / 1e6);
+}
+
+
+std::vector<int32_t> make_signal(size_t size, uint8_t channel_count, uint8_t sample_bit_size,
+																						uint32_t seed)
+{   // planar, size apart: a few partials plus noise, at a quarter of full scale
+	auto generator = std::mt19937{seed};
+	auto noise = std::normal_distribution<double>{0.0, 0.002};
+	const auto amplitude = std::ldexp(1.0, sample_bit_size - 3);
+	const auto max_value = (int32_t)(std::ldexp(1.0, sample_bit_size - 1) - 1);
+
+	auto res = std::vector<int32_t>(size * channel_count);
+	for (uint8_t channel_idx = 0; channel_idx < channel_count; ++channel_idx)
+		for (size_t i = 0; i < size; ++i) {
+			const auto t = 2 * std::numbers::pi * i / 44100.0;
+			const auto value = 0.5 * std::sin(440.0 * t + channel_idx) + 0.3 * std::sin(1234.5 * t) +
+													0.2 * std::sin(5021.0 * t) + noise(generator);
+			res[channel_idx * size + i] = std::clamp((int32_t)std::lround(amplitude * value),
+																				-max_value, max_value);
+		}
+
+	return res;
+}
+
+
+void bench_rice()
+{   // bit::input::get_rice_ints() over one residual partition per call
+	auto generator = std::mt19937{1};
+
+	for (uint8_t parameter: {2, 6, 12}) {
+		auto residuals = std::vector<int32_t>(block_size);
+		auto distribution = std::normal_distribution<double>{0.0, std::ldexp(1.0, parameter)};
+		for (auto &value: residuals)
+			value = (int32_t)std::lround(distribution(generator));
+
+		auto coded = bit::output{};
+		coded.put_rice_ints(residuals.data(), residuals.size(), parameter);
+		coded.put_uint(0, 64);  // slack for the word-cached reader
+		coded.align();
+
+		const auto data = coded.data();
+		auto decoded = std::vector<int32_t>(block_size);
+		const auto seconds = measure([&]() {
+			auto istream = memory::input{data};
+			auto bit_istream = bit::input<memory::input>{istream};
+			bit_istream.get_rice_ints(decoded.data(), decoded.size(), parameter);
+		});
+		if (decoded != residuals)
+			throw error{"rice round trip failed (parameter %u)", parameter};
+
+		char name[64];
+		std::snprintf(name, sizeof(name), "bit::get_rice_ints parameter=%u", parameter);
+		report(name, seconds, coded.bit_size() / 8 - 8, block_size);
+	}
+}
+
+
+void bench_verbatim()
+{   // bit::input::get_ints() against get_int() calls over one VERBATIM block per call
+	for (uint8_t bit_count: {12, 16, 24}) {
+		const auto signal = make_signal(block_size, 1, bit_count, 8);
+		auto coded = bit::output{};
+		for (auto value: signal)
+			coded.put_int(value, bit_count);
+		coded.put_uint(0, 64);
+		coded.align();
+
+		const auto data = coded.data();
+		auto decoded = std::vector<int32_t>(block_size);
+		auto seconds = measure([&]() {
+			auto istream = memory::input{data};
+			auto bit_istream = bit::input<memory::input>{istream};
+			bit_istream.get_ints(decoded.data(), decoded.size(), bit_count);
+		});
+		if (decoded != signal)
+			throw error{"verbatim round trip failed (%ub)", bit_count};
+
+		char name[64];
+		std::snprintf(name, sizeof(name), "bit::get_ints bits=%u", bit_count);
+		report(name, seconds, block_size * bit_count / 8, block_size);
+
+		seconds = measure([&]() {
+			auto istream = memory::input{data};
+			auto bit_istream = bit::input<memory::input>{istream};
+			for (auto &value: decoded)
+				value = bit_istream.get_int(bit_count);
+		});
+		std::snprintf(name, sizeof(name), "bit::get_int bits=%u", bit_count);
+		report(name, seconds, block_size * bit_count / 8, block_size);
+	}
+}
+
+
+void bench_lpc()
+{   // lpc::restore_fixed() and lpc::restore() over one block per call, restoring a copy of it
+	const auto signal = make_signal(block_size, 1, 16, 2);
+	auto samples = std::vector<int32_t>(block_size);
+
+	for (uint8_t order = 0; order <= lpc::max_fixed_order; ++order) {
+		const auto seconds = measure([&]() {
+			std::copy(signal.begin(), signal.end(), samples.begin());
+			lpc::restore_fixed(samples.data(), samples.size(), order);
+		});
+
+		char name[64];
+		std::snprintf(name, sizeof(name), "lpc::restore_fixed order=%u", order);
+		report(name, seconds, block_size * sizeof(int32_t), block_size);
+	}
+
+	for (uint8_t order: {1, 8, 12, 20, 32}) {
+		for (uint8_t sample_bit_size: {16, 24}) {
+			const auto precision = uint8_t{12};
+			auto coefficients = std::vector<int32_t>(order);
+			for (uint8_t j = 0; j < order; ++j)  // a decaying, stable predictor
+				coefficients[j] = (int32_t)(((j % 2 == 0) ? 1 : -1) * (1 << (precision - 2)) / (j + 1));
+
+			auto residuals = make_signal(block_size, 1, sample_bit_size - 8, 3);
+			const auto seconds = measure([&]() {
+				std::copy(residuals.begin(), residuals.end(), samples.begin());
+				lpc::restore(samples.data(), samples.size(), coefficients.data(), order, precision - 1,
+																			sample_bit_size, precision);
+			});
+
+			char name[64];
+			std::snprintf(name, sizeof(name), "lpc::restore order=%u bits=%u", order, sample_bit_size);
+			report(name, seconds, block_size * sizeof(int32_t), block_size);
+		}
+	}
+}
+
+
+void bench_pcm()
+{   // pcm::pack(), pcm::pack_stereo(), pcm::unpack() and pcm::convert() over one stereo block per call
+	const auto signal = make_signal(block_size, 2, 16, 4);
+	const auto planar = sample_view<const int32_t>{signal.data(), block_size, 2, block_size};
+	auto out = std::vector<std::byte>(block_size * 2 * 4);
+
+	for (auto format: {pcm::format::int8, pcm::format::int16, pcm::format::int24, pcm::format::int32}) {
+		const auto byte_size = block_size * 2 * pcm::sample_byte_size(format);
+		const auto seconds = measure([&]() {
+			pcm::pack(out.data(), planar, block_size, format);
+		});
+
+		char name[64];
+		std::snprintf(name, sizeof(name), "pcm::pack stereo bits=%u", (unsigned)format);
+		report(name, seconds, byte_size, block_size * 2);
+	}
+
+	const auto *left = signal.data();
+	const auto *right = signal.data() + block_size;
+	for (auto coding: {pcm::stereo_coding::left_side, pcm::stereo_coding::mid_side}) {
+		const auto seconds = measure([&]() {
+			pcm::pack_stereo(out.data(), left, right, block_size, coding, pcm::format::int16);
+		});
+
+		char name[64];
+		std::snprintf(name, sizeof(name), "pcm::pack_stereo %s bits=16",
+								(coding == pcm::stereo_coding::left_side) ? "left_side" : "mid_side");
+		report(name, seconds, block_size * 2 * 2, block_size * 2);
+	}
+
+	pcm::pack(out.data(), planar, block_size, pcm::format::int16);
+	auto unpacked = std::vector<int32_t>(block_size * 2);
+	const auto seconds = measure([&]() {
+		const auto planar_out = sample_view<int32_t>{unpacked.data(), block_size, 2, block_size};
+		pcm::unpack(planar_out, out.data(), block_size, pcm::format::int16);
+	});
+	report("pcm::unpack stereo bits=16", seconds, block_size * 2 * 2, block_size * 2);
+
+	const auto signal_24 = make_signal(block_size, 2, 24, 4);
+	const auto planar_24 = sample_view<const int32_t>{signal_24.data(), block_size, 2, block_size};
+	auto noise = pcm::dither{};
+	for (auto format: {pcm::format::float32, pcm::format::int16}) {
+		const auto byte_size = block_size * 2 * pcm::sample_byte_size(format);
+		const auto seconds = measure([&]() {
+			pcm::convert(out.data(), planar_24, block_size, 24, format, noise);
+		});
+
+		report((format == pcm::format::float32) ? "pcm::convert stereo bits=24 to float32" :
+														"pcm::convert stereo bits=24 to 16, dithered",
+																	seconds, byte_size, block_size * 2);
+	}
+}
+
+
+void bench_wave()
+{   // wave::encoder::encode_sample() and encode_block() over one stereo block per call
+	const auto signal = make_signal(block_size, 2, 16, 5);
+	const auto planar = sample_view<const int32_t>{signal.data(), block_size, 2, block_size};
+
+	for (uint8_t sample_bit_size: {16, 24}) {
+		auto ostream = byte_ostream{};
+		auto encoder = wave::encoder{ostream, wave::streaminfo_type{44100, sample_bit_size, 2, 0}};
+		const auto byte_size = block_size * 2 * sample_bit_size / 8;
+		ostream.data.reserve(byte_size * 2);
+
+		auto seconds = measure([&]() {
+			ostream.data.clear();
+			for (size_t i = 0; i < block_size; ++i) {
+				encoder.encode_sample(signal[i]);
+				encoder.encode_sample(signal[block_size + i]);
+			}
+		});
+
+		char name[64];
+		std::snprintf(name, sizeof(name), "wave::encode_sample stereo bits=%u", sample_bit_size);
+		report(name, seconds, byte_size, block_size * 2);
+
+		seconds = measure([&]() {
+			ostream.data.clear();
+			encoder.encode_block(planar, block_size);
+		});
+		std::snprintf(name, sizeof(name), "wave::encode_block stereo bits=%u", sample_bit_size);
+		report(name, seconds, byte_size, block_size * 2);
+	}
+}
+
+
+void bench_checksums()
+{   // crc::crc16(), crc::crc8() and md5::context::update() over 64 KiB per call
+	auto data = std::vector<std::byte>(64 * 1024);
+	auto generator = std::mt19937{6};
+	for (auto &byte: data)
+		byte = (std::byte)generator();
+
+	volatile uint16_t crc{0};
+	auto seconds = measure([&]() {
+		crc = crc::crc16(data.data(), data.size());
+	});
+	report("crc::crc16", seconds, data.size(), 0);
+
+	seconds = measure([&]() {
+		crc = crc::crc8(data.data(), data.size());
+	});
+	report("crc::crc8", seconds, data.size(), 0);
+
+	auto context = md5::context{};
+	seconds = measure([&]() {
+		context.update(data.data(), data.size());
+	});
+	report("md5::context::update", seconds, data.size(), 0);
+}
+
+
+void bench_decode()
+{   // flac::decoder over a whole encoded stereo stream per call
+	const size_t sample_count = 10 * 44100;
+
+	for (uint8_t sample_bit_size: {16, 24}) {
+		const auto signal = make_signal(sample_count, 2, sample_bit_size, 7);
+		const auto planar = sample_view<const int32_t>{signal.data(), sample_count, 2, sample_count};
+
+		for (uint16_t max_block_size: {1152, 4096}) {
+			for (uint8_t max_lpc_order: {0, 8, 12, 32}) {
+				auto ostream = byte_ostream{};
+				auto streaminfo = flac::streaminfo_type{};
+				streaminfo.max_block_size = max_block_size;
+				streaminfo.sample_rate = 44100;
+				streaminfo.channel_count = 2;
+				streaminfo.sample_bit_size = sample_bit_size;
+
+				auto encoder = flac::encoder{ostream, streaminfo, 0, max_lpc_order};
+				encoder.encode_marker();
+				encoder.encode_metadata();
+				encoder.encode_audio(planar, sample_count);
+				encoder.finish();
+
+				size_t decoded_count{0};
+				const auto seconds = measure([&]() {
+					auto istream = memory::input{ostream.data};
+					auto decoder = flac::decoder{istream};
+					decoder.decode_marker();
+					while (decoder.state() != flac::decoder_state::has_metadata)
+						decoder.decode_metadata();
+					decoded_count = 0;
+					for (decoder.decode_audio(); decoder.state() != flac::decoder_state::complete;
+																				decoder.decode_audio())
+						decoded_count += decoder.block_size();
+				});
+				if (decoded_count != sample_count)
+					throw error{"decoded %zu samples of %zu", decoded_count, sample_count};
+
+				char name[64];
+				std::snprintf(name, sizeof(name), "flac::decoder bits=%u block=%u lpc<=%u",
+														sample_bit_size, max_block_size, max_lpc_order);
+				report(name, seconds, ostream.data.size(), sample_count * 2);
+			}
+		}
+	}
+}
+
+
+void bench_batch()
+{   // 64 one-second stereo 16-bit streams per call, one flac::decoder each or a flac::batch_decoder
+	const size_t stream_count = 64;
+	const size_t sample_count = 44100;
+
+	auto streams = std::vector<std::vector<std::byte>>{};
+	auto views = std::vector<std::span<const std::byte>>{};
+	size_t byte_size{0};
+	for (size_t stream_idx = 0; stream_idx < stream_count; ++stream_idx) {
+		const auto signal = make_signal(sample_count, 2, 16, 11 + stream_idx);
+		auto ostream = byte_ostream{};
+		auto streaminfo = flac::streaminfo_type{};
+		streaminfo.sample_rate = 44100;
+		streaminfo.channel_count = 2;
+		streaminfo.sample_bit_size = 16;
+
+		auto encoder = flac::encoder{ostream, streaminfo};
+		encoder.encode_marker();
+		encoder.encode_metadata();
+		const auto planar = sample_view<const int32_t>{signal.data(), sample_count, 2, sample_count};
+		encoder.encode_audio(planar, sample_count);
+		encoder.finish();
+		byte_size += ostream.data.size();
+		streams.push_back(std::move(ostream.data));
+	}
+	for (const auto &stream: streams)
+		views.push_back(stream);
+
+	size_t decoded_count{0};
+	auto seconds = measure([&]() {
+		decoded_count = 0;
+		for (const auto &view: views) {
+			auto istream = memory::input{view};
+			auto decoder = flac::decoder{istream};
+			decoder.decode_marker();
+			while (decoder.state() != flac::decoder_state::has_metadata)
+				decoder.decode_metadata();
+			for (decoder.decode_audio(); decoder.state() != flac::decoder_state::complete;
+																				decoder.decode_audio())
+				decoded_count += decoder.block_size();
+		}
+	});
+	if (decoded_count != stream_count * sample_count)
+		throw error{"decoded %zu samples of %zu", decoded_count, stream_count * sample_count};
+	report("flac::decoder streams=64", seconds, byte_size, stream_count * sample_count * 2);
+
+	auto batch = flac::batch_decoder{};
+	auto batch_count = std::atomic<size_t>{0};
+	seconds = measure([&]() {
+		batch_count = 0;
+		batch.decode(views,
+			[&batch_count](size_t, const auto &decoder) { batch_count += decoder.block_size(); },
+			[](size_t, const error &err) { throw err; });
+	});
+	if (batch_count != stream_count * sample_count)
+		throw error{"decoded %zu samples of %zu", batch_count.load(), stream_count * sample_count};
+
+	char name[64];
+	std::snprintf(name, sizeof(name), "flac::batch_decoder streams=64 threads=%zu",
+																				batch.thread_count());
+	report(name, seconds, byte_size, stream_count * sample_count * 2);
+}
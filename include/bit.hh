@@ -0,0 +1,728 @@
+/* Copyright (C) 2024  Bogdan-Gabriel Alecu  (GameInstance.com)
+ *
+ * audio - C++ audio codecs.
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIO_BIT
+#define AUDIO_BIT
+
+#include <algorithm>
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <vector>
+#include <basics/error.hh>
+#include <stream/bit.hh>
+#include "memory.hh"
+
+
+/*******************************************************************************************************
+ *
+ * @name  Bit reader
+ *
+ * @brief Word-cached, MSB-first bit reader and writer for codec bitstreams.
+ *
+ * The audio::bit::input class template pulls whole bytes from istream into a 64-bit cache and serves
+ * bit fields from it, so that most reads are a shift and a mask rather than one upstream call per bit.
+ * The get_unary() member function counts the zero bits preceding the next set bit with countl_zero
+ * over the cached word. The get_ints() member function reads a run of signed fields of one width, as
+ * found in a FLAC VERBATIM subframe; a memory source on a byte boundary serves 8, 16, 24 and 32-bit
+ * fields as big-endian loads straight from memory. The get_rice_ints() member function decodes a run
+ * of zig-zag Rice codes sharing one parameter, as found in a FLAC residual partition. The position()
+ * member function returns the number of whole bytes consumed so far. Reading past the end of istream
+ * throws. A memory::input istream, or one derived from it, is read directly rather than through a
+ * stream::bit::input: the cache is refilled by single unaligned 64-bit loads, and seek() jumps to any
+ * byte position in constant time. The skip() member function drops a number of bytes, from a byte
+ * boundary: memory sources seek past them, other sources read them through one at a time.
+ *
+ * The bytes() member function returns the stream bytes between two positions, e.g. for checksums over
+ * a frame once it is read. Memory sources return a view of their data; other sources need record() on
+ * first, so that they keep the bytes they read, and release() to drop those no longer needed.
+ *
+ * The audio::bit::output class writes bit fields MSB-first into a member byte vector, through a 64-bit
+ * cache flushed 32 bits at a time. The put_rice_ints() member function writes zig-zag Rice codes, most
+ * of them in a single cache update, and put_bits() appends the bits of another output. The data()
+ * member function returns the whole bytes written so far, i.e. all of them after align().
+ *
+ */
+
+
+namespace audio {
+namespace bit {
+
+
+template<typename INPUT_STREAM>
+class source {  // byte source, through a generic bit stream
+public:
+	explicit source(INPUT_STREAM &istream);
+
+	inline uint8_t get_byte();
+	inline bool eos();
+	inline size_t position() const;
+	inline void record(bool is_recording, uint64_t cache, uint8_t byte_count);
+	inline std::span<const std::byte> bytes(size_t begin, size_t end) const;
+	inline void release(size_t position);
+
+private:
+	stream::bit::input<INPUT_STREAM> _istream;
+	size_t _position;
+	bool _is_recording;
+	std::vector<std::byte> _history;  // read bytes, from _history_position on
+	size_t _history_position;
+};
+
+
+template<typename INPUT_STREAM>
+	requires std::derived_from<INPUT_STREAM, memory::input>
+class source<INPUT_STREAM> {  // byte source, straight from memory
+public:
+	explicit source(memory::input &istream);
+
+	inline uint8_t get_byte();
+	inline bool has_word() const;
+	inline uint64_t get_word(uint8_t byte_count);
+	inline bool eos() const;
+	inline size_t position() const;
+	inline void seek(size_t position);
+	inline std::span<const std::byte> data() const;
+	inline std::span<const std::byte> bytes(size_t begin, size_t end) const;
+
+private:
+	std::span<const std::byte> _data;
+	size_t _position;
+};
+
+
+template<typename INPUT_STREAM>
+class input {
+public:
+	explicit input(INPUT_STREAM &istream);
+
+	inline uint64_t get_uint(uint8_t bit_count);
+	inline int64_t get_int(uint8_t bit_count);
+	inline uint8_t get_byte();
+	inline uint32_t get_unary();
+	template<typename T>
+	inline void get_ints(T *values, size_t count, uint8_t bit_count);
+	template<typename T>
+	inline void get_rice_ints(T *values, size_t count, uint8_t parameter);
+	inline void align();
+	inline void skip(size_t byte_count);  // on a byte boundary
+	inline bool eos();
+	inline size_t position() const;
+	inline void seek(size_t position);  // random access sources only
+	inline std::span<const std::byte> data() const;  // memory sources only
+	inline void record(bool is_recording);  // keeps the bytes from position() on for bytes()
+	inline std::span<const std::byte> bytes(size_t begin, size_t end) const;
+	inline void release(size_t position);  // drops the recorded bytes before position
+
+private:
+	template<uint8_t BYTE_COUNT, typename T>
+	inline void _get_byte_ints(T *values, size_t count);
+	inline void _refill();
+	inline void _assert_cached(uint8_t bit_count);
+
+	source<INPUT_STREAM> _istream;
+	uint64_t _cache;      // left-aligned, unused low bits are zero
+	uint8_t _cache_size;  // bits
+};
+
+
+class output {
+public:
+	output();
+
+	inline void put_uint(uint64_t value, uint8_t bit_count);
+	inline void put_int(int64_t value, uint8_t bit_count);
+	inline void put_unary(uint32_t zero_count);
+	template<typename T>
+	inline void put_rice_ints(const T *values, size_t count, uint8_t parameter);
+	inline void put_bits(const output &other);
+	inline void align();
+	inline void clear();
+	inline size_t bit_size() const;
+	inline std::span<const std::byte> data() const;
+
+private:
+	inline void _put(uint32_t value, uint8_t bit_count);
+
+	std::vector<std::byte> _data;
+	uint64_t _cache;      // right-aligned, unwritten bits
+	uint8_t _cache_size;  // bits, less than 32 between calls
+};
+
+
+/******************************************************************************************************/
+
+
+static constexpr const char *_source_name = "audio::bit::source";
+static constexpr const char *_input_name = "audio::bit::input";
+static constexpr uint8_t _cache_bit_size = 64;
+
+
+template<typename INPUT_STREAM>
+source<INPUT_STREAM>::source(INPUT_STREAM &upstream)
+	: _istream{upstream}, _position{0}, _is_recording{false}, _history{}, _history_position{0}
+{
+}
+
+
+template<typename INPUT_STREAM>
+inline uint8_t source<INPUT_STREAM>::get_byte()
+{
+	const auto res = (uint8_t)_istream.get_byte();
+	++_position;
+	if (_is_recording)
+		_history.push_back((std::byte)res);
+
+	return res;
+}
+
+
+template<typename INPUT_STREAM>
+inline bool source<INPUT_STREAM>::eos()
+{
+	return _istream.eos();
+}
+
+
+template<typename INPUT_STREAM>
+inline size_t source<INPUT_STREAM>::position() const
+{
+	return _position;
+}
+
+
+template<typename INPUT_STREAM>
+inline void source<INPUT_STREAM>::record(bool is_recording, uint64_t cache, uint8_t byte_count)
+{
+	// the history starts with the byte_count bytes read ahead into the cache
+	_is_recording = is_recording;
+	_history.clear();
+	_history_position = _position - byte_count;
+	if (!is_recording)
+		return;
+
+	for (uint8_t i = 0; i < byte_count; ++i)
+		_history.push_back((std::byte)(cache >> (_cache_bit_size - 8 * (i + 1))));
+}
+
+
+template<typename INPUT_STREAM>
+inline std::span<const std::byte> source<INPUT_STREAM>::bytes(size_t begin, size_t end) const
+{
+	if (!_is_recording || (begin < _history_position) || (end > _position) || (begin > end))
+		throw basics::error{"%s: (assertion failed) bytes [%zu, %zu) not recorded",
+																			_source_name, begin, end};
+
+	return {_history.data() + (begin - _history_position), end - begin};
+}
+
+
+template<typename INPUT_STREAM>
+inline void source<INPUT_STREAM>::release(size_t position)
+{   // O(read-ahead bytes)
+	if (!_is_recording || (position <= _history_position))
+		return;
+
+	const auto byte_count = std::min(position - _history_position, _history.size());
+	_history.erase(_history.begin(), _history.begin() + byte_count);
+	_history_position += byte_count;
+}
+
+
+template<typename INPUT_STREAM>
+	requires std::derived_from<INPUT_STREAM, memory::input>
+source<INPUT_STREAM>::source(memory::input &upstream)
+	: _data{upstream.data()}, _position{0}
+{
+}
+
+
+template<typename INPUT_STREAM>
+	requires std::derived_from<INPUT_STREAM, memory::input>
+inline uint8_t source<INPUT_STREAM>::get_byte()
+{
+	return (uint8_t)_data[_position++];
+}
+
+
+template<typename INPUT_STREAM>
+	requires std::derived_from<INPUT_STREAM, memory::input>
+inline bool source<INPUT_STREAM>::has_word() const
+{
+	return _data.size() - _position >= sizeof(uint64_t);
+}
+
+
+template<typename INPUT_STREAM>
+	requires std::derived_from<INPUT_STREAM, memory::input>
+inline uint64_t source<INPUT_STREAM>::get_word(uint8_t byte_count)
+{   // the next 8 bytes, big-endian, consuming byte_count of them
+	uint64_t res;
+	std::memcpy(&res, _data.data() + _position, sizeof(res));
+	_position += byte_count;
+
+	if constexpr (std::endian::native == std::endian::little)
+		return std::byteswap(res);
+	else
+		return res;
+}
+
+
+template<typename INPUT_STREAM>
+	requires std::derived_from<INPUT_STREAM, memory::input>
+inline bool source<INPUT_STREAM>::eos() const
+{
+	return _position == _data.size();
+}
+
+
+template<typename INPUT_STREAM>
+	requires std::derived_from<INPUT_STREAM, memory::input>
+inline size_t source<INPUT_STREAM>::position() const
+{
+	return _position;
+}
+
+
+template<typename INPUT_STREAM>
+	requires std::derived_from<INPUT_STREAM, memory::input>
+inline void source<INPUT_STREAM>::seek(size_t position)
+{
+	_position = std::min(position, _data.size());
+}
+
+
+template<typename INPUT_STREAM>
+	requires std::derived_from<INPUT_STREAM, memory::input>
+inline std::span<const std::byte> source<INPUT_STREAM>::data() const
+{
+	return _data;
+}
+
+
+template<typename INPUT_STREAM>
+	requires std::derived_from<INPUT_STREAM, memory::input>
+inline std::span<const std::byte> source<INPUT_STREAM>::bytes(size_t begin, size_t end) const
+{
+	if ((begin > end) || (end > _data.size()))
+		throw basics::error{"%s: (assertion failed) bytes [%zu, %zu) out of range",
+																			_source_name, begin, end};
+
+	return _data.subspan(begin, end - begin);
+}
+
+
+template<typename INPUT_STREAM>
+input<INPUT_STREAM>::input(INPUT_STREAM &upstream)
+	: _istream{upstream}, _cache{0}, _cache_size{0}
+{
+}
+
+
+template<typename INPUT_STREAM>
+inline uint64_t input<INPUT_STREAM>::get_uint(uint8_t bit_count)
+{
+	if (bit_count == 0)
+		return 0;
+
+	if (bit_count > _cache_bit_size - 8) {  // wider than a guaranteed refill
+		const auto high = get_uint(bit_count - 32);
+
+		return (high << 32) | get_uint(32);
+	}
+
+	_assert_cached(bit_count);
+
+	const auto res = _cache >> (_cache_bit_size - bit_count);
+	_cache <<= bit_count;
+	_cache_size -= bit_count;
+
+	return res;
+}
+
+
+template<typename INPUT_STREAM>
+inline int64_t input<INPUT_STREAM>::get_int(uint8_t bit_count)
+{
+	if (bit_count == 0)
+		return 0;
+
+	const auto shift = _cache_bit_size - bit_count;
+
+	return (int64_t)(get_uint(bit_count) << shift) >> shift;
+}
+
+
+template<typename INPUT_STREAM>
+inline uint8_t input<INPUT_STREAM>::get_byte()
+{
+	return get_uint(8);
+}
+
+
+template<typename INPUT_STREAM>
+inline uint32_t input<INPUT_STREAM>::get_unary()
+{   // O(zero bit count / 64)
+	uint32_t res{0};
+	for (;;) {
+		const auto zero_count = (uint8_t)std::countl_zero(_cache);  // 64 for an empty cache
+		if (zero_count < _cache_size) {
+			_cache <<= zero_count;
+			_cache <<= 1;
+			_cache_size -= zero_count + 1;
+
+			return res + zero_count;
+		}
+
+		res += _cache_size;
+		_cache = 0;
+		_cache_size = 0;
+		_assert_cached(1);
+	}
+}
+
+
+template<typename INPUT_STREAM>
+template<typename T>
+inline void input<INPUT_STREAM>::get_ints(T *values, size_t count, uint8_t bit_count)
+{   // O(count)
+	if (bit_count == 0) {
+		std::fill_n(values, count, T{0});
+
+		return;
+	}
+
+	if (bit_count > _cache_bit_size - 8) {  // wider than a guaranteed refill
+		for (size_t i = 0; i < count; ++i)
+			values[i] = (T)get_int(bit_count);
+
+		return;
+	}
+
+	if constexpr (std::derived_from<INPUT_STREAM, memory::input>) {
+		if ((_cache_size % 8 == 0) && (bit_count % 8 == 0)) {  // whole bytes, on a byte boundary
+			switch (bit_count) {
+				case 8:
+					return _get_byte_ints<1>(values, count);
+				case 16:
+					return _get_byte_ints<2>(values, count);
+				case 24:
+					return _get_byte_ints<3>(values, count);
+				case 32:
+					return _get_byte_ints<4>(values, count);
+			}
+		}
+	}
+
+	const auto shift = _cache_bit_size - bit_count;
+	for (size_t i = 0; i < count;) {
+		_assert_cached(bit_count);
+		// every field the refilled cache holds, without further checks
+		const auto field_count = std::min<size_t>(count - i, _cache_size / bit_count);
+		for (const auto end = i + field_count; i < end; ++i) {
+			values[i] = (T)((int64_t)_cache >> shift);
+			_cache <<= bit_count;
+		}
+		_cache_size -= field_count * bit_count;
+	}
+}
+
+
+template<typename INPUT_STREAM>
+template<typename T>
+inline void input<INPUT_STREAM>::get_rice_ints(T *values, size_t count, uint8_t parameter)
+{   // O(count)
+	for (size_t i = 0; i < count; ++i) {
+		_refill();
+
+		uint64_t uval;
+		const auto zero_count = (uint8_t)std::countl_zero(_cache);
+		if (zero_count + 1 + parameter <= _cache_size) {  // whole code is cached
+			auto bits = (_cache << zero_count) << 1;
+			uval = (uint64_t)zero_count << parameter;
+			if (parameter > 0) {
+				uval |= bits >> (_cache_bit_size - parameter);
+				bits <<= parameter;
+			}
+			_cache = bits;
+			_cache_size -= zero_count + 1 + parameter;
+		} else {  // long unary prefix, spanning refills
+			uval = ((uint64_t)get_unary() << parameter) | get_uint(parameter);
+		}
+
+		values[i] = (T)((int64_t)(uval >> 1) ^ -(int64_t)(uval & 1));
+	}
+}
+
+
+template<typename INPUT_STREAM>
+inline void input<INPUT_STREAM>::align()
+{
+	// the cache is filled by whole bytes, so the partial byte sits at its top
+	const auto bit_count = (uint8_t)(_cache_size % 8);
+	_cache <<= bit_count;
+	_cache_size -= bit_count;
+}
+
+
+template<typename INPUT_STREAM>
+inline void input<INPUT_STREAM>::skip(size_t byte_count)
+{   // O(1) for memory sources, O(byte_count) otherwise
+	if constexpr (std::derived_from<INPUT_STREAM, memory::input>) {
+		const auto begin = position();
+		if (_istream.data().size() - begin < byte_count)
+			throw basics::error{"%s: (protocol error) unexpected end of stream", _input_name};
+
+		seek(begin + byte_count);
+	} else {
+		for (; byte_count > 0; --byte_count)
+			get_byte();
+	}
+}
+
+
+template<typename INPUT_STREAM>
+inline bool input<INPUT_STREAM>::eos()
+{
+	return (_cache_size == 0) && _istream.eos();
+}
+
+
+template<typename INPUT_STREAM>
+inline size_t input<INPUT_STREAM>::position() const
+{
+	return _istream.position() - (_cache_size + 7) / 8;
+}
+
+
+template<typename INPUT_STREAM>
+inline void input<INPUT_STREAM>::seek(size_t position)
+{
+	_istream.seek(position);
+	_cache = 0;
+	_cache_size = 0;
+}
+
+
+template<typename INPUT_STREAM>
+inline std::span<const std::byte> input<INPUT_STREAM>::data() const
+{
+	return _istream.data();
+}
+
+
+template<typename INPUT_STREAM>
+inline void input<INPUT_STREAM>::record(bool is_recording)
+{
+	if constexpr (!std::derived_from<INPUT_STREAM, memory::input>) {
+		// whole cached bytes only; call on a byte boundary
+		_istream.record(is_recording, _cache, _cache_size / 8);
+	}
+}
+
+
+template<typename INPUT_STREAM>
+inline std::span<const std::byte> input<INPUT_STREAM>::bytes(size_t begin, size_t end) const
+{
+	return _istream.bytes(begin, end);
+}
+
+
+template<typename INPUT_STREAM>
+inline void input<INPUT_STREAM>::release(size_t position)
+{
+	if constexpr (!std::derived_from<INPUT_STREAM, memory::input>)
+		_istream.release(position);
+}
+
+
+template<typename INPUT_STREAM>
+template<uint8_t BYTE_COUNT, typename T>
+inline void input<INPUT_STREAM>::_get_byte_ints(T *values, size_t count)
+{   // O(count); the cache holds whole bytes, so position() is exact
+	const auto begin = position();
+	if (_istream.data().size() - begin < count * BYTE_COUNT)
+		throw basics::error{"%s: (protocol error) unexpected end of stream", _input_name};
+
+	const auto *bytes = (const uint8_t *)_istream.data().data() + begin;
+	for (size_t i = 0; i < count; ++i, bytes += BYTE_COUNT) {
+		uint32_t value{0};
+		for (uint8_t j = 0; j < BYTE_COUNT; ++j)
+			value = (value << 8) | bytes[j];
+
+		constexpr auto shift = 32 - 8 * BYTE_COUNT;
+		values[i] = (T)((int32_t)(value << shift) >> shift);
+	}
+
+	seek(begin + count * BYTE_COUNT);
+}
+
+
+template<typename INPUT_STREAM>
+inline void input<INPUT_STREAM>::_refill()
+{
+	if constexpr (std::derived_from<INPUT_STREAM, memory::input>) {
+		// one unaligned word load, keeping only the whole bytes that fit
+		if ((_cache_size <= _cache_bit_size - 8) && _istream.has_word()) {
+			const auto byte_count = (uint8_t)((_cache_bit_size - _cache_size) / 8);
+			const auto mask = ~uint64_t{0} << (_cache_bit_size - 8 * byte_count);
+			const auto word = _istream.get_word(byte_count) & mask;
+			_cache |= word >> _cache_size;
+			_cache_size += 8 * byte_count;
+
+			return;
+		}
+	}
+
+	while ((_cache_size <= _cache_bit_size - 8) && !_istream.eos()) {
+		_cache |= (uint64_t)_istream.get_byte() << (_cache_bit_size - 8 - _cache_size);
+		_cache_size += 8;
+	}
+}
+
+
+template<typename INPUT_STREAM>
+inline void input<INPUT_STREAM>::_assert_cached(uint8_t bit_count)
+{
+	if (_cache_size >= bit_count)
+		return;
+
+	_refill();
+	if (_cache_size < bit_count)
+		throw basics::error{"%s: (protocol error) unexpected end of stream", _input_name};
+}
+
+
+inline output::output()
+	: _data{}, _cache{0}, _cache_size{0}
+{
+}
+
+
+inline void output::put_uint(uint64_t value, uint8_t bit_count)
+{
+	if (bit_count > 32) {
+		_put((uint32_t)(value >> 32), bit_count - 32);
+		bit_count = 32;
+	}
+
+	_put((uint32_t)value, bit_count);
+}
+
+
+inline void output::put_int(int64_t value, uint8_t bit_count)
+{
+	put_uint((uint64_t)value, bit_count);
+}
+
+
+inline void output::put_unary(uint32_t zero_count)
+{   // O(zero_count / 32)
+	for (; zero_count >= 32; zero_count -= 32)
+		_put(0, 32);
+	_put(1, zero_count + 1);
+}
+
+
+template<typename T>
+inline void output::put_rice_ints(const T *values, size_t count, uint8_t parameter)
+{   // O(count)
+	const auto mask = (uint32_t)((uint64_t{1} << parameter) - 1);
+	for (size_t i = 0; i < count; ++i) {
+		const auto uval = ((uint64_t)values[i] << 1) ^ (uint64_t)((int64_t)values[i] >> 63);
+		const auto zero_count = uval >> parameter;
+		if (zero_count + 1 + parameter <= 32) {  // one cache update
+			_put((uint32_t)(1u << parameter) | ((uint32_t)uval & mask),
+																(uint8_t)(zero_count + 1 + parameter));
+		} else {
+			put_unary((uint32_t)zero_count);
+			_put((uint32_t)uval & mask, parameter);
+		}
+	}
+}
+
+
+inline void output::put_bits(const output &other)
+{   // O(other bit size)
+	if (_cache_size == 0)
+		_data.insert(_data.end(), other._data.begin(), other._data.end());
+	else
+		for (const auto byte: other._data)
+			_put((uint32_t)byte, 8);
+
+	_put((uint32_t)other._cache, other._cache_size);
+}
+
+
+inline void output::align()
+{
+	if (_cache_size % 8 != 0)
+		_put(0, 8 - _cache_size % 8);
+	for (; _cache_size > 0; _cache_size -= 8)
+		_data.push_back((std::byte)(_cache >> (_cache_size - 8)));
+}
+
+
+inline void output::clear()
+{
+	_data.clear();
+	_cache = 0;
+	_cache_size = 0;
+}
+
+
+inline size_t output::bit_size() const
+{
+	return 8 * _data.size() + _cache_size;
+}
+
+
+inline std::span<const std::byte> output::data() const
+{
+	return _data;
+}
+
+
+inline void output::_put(uint32_t value, uint8_t bit_count)
+{
+	if (bit_count == 0)
+		return;
+
+	// written bits linger above _cache_size until they are shifted out
+	_cache = (_cache << bit_count) | (value & (uint32_t)((uint64_t{1} << bit_count) - 1));
+	_cache_size += bit_count;
+	if (_cache_size < 32)
+		return;
+
+	_cache_size -= 32;
+	const auto word = (uint32_t)(_cache >> _cache_size);
+	const auto offset = _data.size();
+	_data.resize(offset + 4);
+	_data[offset + 0] = (std::byte)(word >> 24);
+	_data[offset + 1] = (std::byte)(word >> 16);
+	_data[offset + 2] = (std::byte)(word >> 8);
+	_data[offset + 3] = (std::byte)word;
+}
+
+
+} // namespace bit
+} // namespace audio
+
+
+#endif // AUDIO_BIT
@@ -0,0 +1,292 @@
+/* Copyright (C) 2024  Bogdan-Gabriel Alecu  (GameInstance.com)
+ *
+ * audio - C++ audio codecs.
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIO_BUFFER
+#define AUDIO_BUFFER
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <utility>
+
+
+/*******************************************************************************************************
+ *
+ * @name  Sample buffers
+ *
+ * @brief Aligned sample storage and planar views over it.
+ *
+ * The audio::aligned_allocator class template allocates ALIGNMENT-byte aligned memory and can back any
+ * standard container. The audio::pooled_allocator class template allocates the same way, but keeps the
+ * blocks it frees in a small per-thread pool and hands them out again for requests of the same size
+ * and alignment, so that a worker thread constructing a decoder or an encoder per stream reuses warm
+ * memory instead of going back to the heap each time; trim_buffer_pool() frees the blocks pooled by
+ * the calling thread, as its exit does. The audio::default_init_allocator class template adapts either
+ * of them, or any ALLOCATOR, so that containers default-initialize their elements instead of zeroing
+ * them: buffers that are always written before they are read skip the fill. The audio::sample_view
+ * class template is a non-owning view of channel_count() planes of size() samples each, laid out
+ * stride() samples apart in one contiguous allocation. The subscript operator returns the plane of a
+ * channel as a std::span.
+ *
+ */
+
+
+namespace audio {
+
+
+static const size_t cache_line_size = 64;
+
+
+template<typename T, size_t ALIGNMENT = cache_line_size>
+class aligned_allocator {
+public:
+	using value_type = T;
+
+	template<typename U>
+	struct rebind {
+		using other = aligned_allocator<U, ALIGNMENT>;
+	};
+
+	aligned_allocator() = default;
+	template<typename U>
+	aligned_allocator(const aligned_allocator<U, ALIGNMENT> &);
+
+	inline T *allocate(size_t size);
+	inline void deallocate(T *data, size_t size);
+
+	template<typename U>
+	bool operator==(const aligned_allocator<U, ALIGNMENT> &) const;
+};
+
+
+template<typename T, size_t ALIGNMENT = cache_line_size>
+class pooled_allocator {
+public:
+	using value_type = T;
+
+	template<typename U>
+	struct rebind {
+		using other = pooled_allocator<U, ALIGNMENT>;
+	};
+
+	pooled_allocator() = default;
+	template<typename U>
+	pooled_allocator(const pooled_allocator<U, ALIGNMENT> &);
+
+	inline T *allocate(size_t size);
+	inline void deallocate(T *data, size_t size);
+
+	template<typename U>
+	bool operator==(const pooled_allocator<U, ALIGNMENT> &) const;
+};
+
+
+void trim_buffer_pool();  // of the calling thread
+
+
+template<typename ALLOCATOR>
+class default_init_allocator : public ALLOCATOR {
+public:
+	using value_type = typename ALLOCATOR::value_type;
+
+	template<typename U>
+	struct rebind {
+		using other =
+			default_init_allocator<typename std::allocator_traits<ALLOCATOR>::template rebind_alloc<U>>;
+	};
+
+	default_init_allocator() = default;
+	template<typename OTHER>
+	default_init_allocator(const default_init_allocator<OTHER> &other);
+
+	template<typename U>
+	void construct(U *data);  // left as allocated for scalar types
+	template<typename U, typename... ARGS>
+	void construct(U *data, ARGS &&...args);
+};
+
+
+template<typename T>
+class sample_view {
+public:
+	sample_view(T *data, size_t stride, uint8_t channel_count, size_t size);
+
+	inline std::span<T> operator[](uint8_t channel_idx) const;
+	inline T *data() const;
+	inline size_t stride() const;
+	inline uint8_t channel_count() const;
+	inline size_t size() const;
+
+private:
+	T *_data;
+	size_t _stride;
+	uint8_t _channel_count;
+	size_t _size;
+};
+
+
+// samples per plane, so that every plane of a planar allocation starts on an ALIGNMENT boundary
+template<typename T, size_t ALIGNMENT = cache_line_size>
+constexpr size_t aligned_stride(size_t size);
+
+
+/******************************************************************************************************/
+
+
+template<typename T, size_t ALIGNMENT>
+template<typename U>
+aligned_allocator<T, ALIGNMENT>::aligned_allocator(const aligned_allocator<U, ALIGNMENT> &)
+{
+}
+
+
+template<typename T, size_t ALIGNMENT>
+inline T *aligned_allocator<T, ALIGNMENT>::allocate(size_t size)
+{
+	return static_cast<T *>(::operator new(size * sizeof(T), std::align_val_t{ALIGNMENT}));
+}
+
+
+template<typename T, size_t ALIGNMENT>
+inline void aligned_allocator<T, ALIGNMENT>::deallocate(T *data, size_t /*size*/)
+{
+	::operator delete(data, std::align_val_t{ALIGNMENT});
+}
+
+
+template<typename T, size_t ALIGNMENT>
+template<typename U>
+bool aligned_allocator<T, ALIGNMENT>::operator==(const aligned_allocator<U, ALIGNMENT> &) const
+{
+	return true;
+}
+
+
+void *_pool_allocate(size_t byte_size, size_t alignment);
+void _pool_deallocate(void *data, size_t byte_size, size_t alignment);
+
+
+template<typename T, size_t ALIGNMENT>
+template<typename U>
+pooled_allocator<T, ALIGNMENT>::pooled_allocator(const pooled_allocator<U, ALIGNMENT> &)
+{
+}
+
+
+template<typename T, size_t ALIGNMENT>
+inline T *pooled_allocator<T, ALIGNMENT>::allocate(size_t size)
+{
+	return static_cast<T *>(_pool_allocate(size * sizeof(T), ALIGNMENT));
+}
+
+
+template<typename T, size_t ALIGNMENT>
+inline void pooled_allocator<T, ALIGNMENT>::deallocate(T *data, size_t size)
+{
+	_pool_deallocate(data, size * sizeof(T), ALIGNMENT);
+}
+
+
+template<typename T, size_t ALIGNMENT>
+template<typename U>
+bool pooled_allocator<T, ALIGNMENT>::operator==(const pooled_allocator<U, ALIGNMENT> &) const
+{
+	return true;
+}
+
+
+template<typename ALLOCATOR>
+template<typename OTHER>
+default_init_allocator<ALLOCATOR>::default_init_allocator(const default_init_allocator<OTHER> &other)
+	: ALLOCATOR{other}
+{
+}
+
+
+template<typename ALLOCATOR>
+template<typename U>
+void default_init_allocator<ALLOCATOR>::construct(U *data)
+{
+	::new((void *)data) U;
+}
+
+
+template<typename ALLOCATOR>
+template<typename U, typename... ARGS>
+void default_init_allocator<ALLOCATOR>::construct(U *data, ARGS &&...args)
+{
+	std::allocator_traits<ALLOCATOR>::construct(static_cast<ALLOCATOR &>(*this), data,
+																		std::forward<ARGS>(args)...);
+}
+
+
+template<typename T>
+sample_view<T>::sample_view(T *data, size_t stride, uint8_t channel_count, size_t size)
+	: _data{data}, _stride{stride}, _channel_count{channel_count}, _size{size}
+{
+}
+
+
+template<typename T>
+inline std::span<T> sample_view<T>::operator[](uint8_t channel_idx) const
+{
+	return {_data + channel_idx * _stride, _size};
+}
+
+
+template<typename T>
+inline T *sample_view<T>::data() const
+{
+	return _data;
+}
+
+
+template<typename T>
+inline size_t sample_view<T>::stride() const
+{
+	return _stride;
+}
+
+
+template<typename T>
+inline uint8_t sample_view<T>::channel_count() const
+{
+	return _channel_count;
+}
+
+
+template<typename T>
+inline size_t sample_view<T>::size() const
+{
+	return _size;
+}
+
+
+template<typename T, size_t ALIGNMENT>
+constexpr size_t aligned_stride(size_t size)
+{
+	constexpr auto samples_per_alignment = (ALIGNMENT > sizeof(T)) ? ALIGNMENT / sizeof(T) : 1;
+
+	return (size + samples_per_alignment - 1) / samples_per_alignment * samples_per_alignment;
+}
+
+
+} // namespace audio
+
+
+#endif // AUDIO_BUFFER
@@ -0,0 +1,109 @@
+/* Copyright (C) 2024  Bogdan-Gabriel Alecu  (GameInstance.com)
+ *
+ * audio - C++ audio codecs.
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIO_CRC
+#define AUDIO_CRC
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+
+/*******************************************************************************************************
+ *
+ * @name  CRC
+ *
+ * @brief Table-driven cyclic redundancy checks.
+ *
+ * The audio::crc::crc8() function computes the CRC-8 of FLAC frame headers, polynomial x^8 + x^2 +
+ * x^1 + x^0, initialized with zero. The audio::crc::crc16() function computes the CRC-16 of whole FLAC
+ * frames, polynomial x^16 + x^15 + x^2 + x^0, initialized with zero, eight bytes per step by the
+ * slice-by-8 method. Their lookup tables are built at compile time.
+ *
+ */
+
+
+namespace audio {
+namespace crc {
+
+
+inline uint8_t crc8(const std::byte *data, size_t size, uint8_t crc = 0);
+inline uint16_t crc16(const std::byte *data, size_t size, uint16_t crc = 0);
+
+
+/******************************************************************************************************/
+
+
+static constexpr std::array<uint8_t, 256> _crc8_table = []() {
+	std::array<uint8_t, 256> res{};
+	for (size_t i = 0; i < res.size(); ++i) {
+		auto crc = (uint8_t)i;
+		for (uint8_t j = 0; j < 8; ++j)
+			crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+		res[i] = crc;
+	}
+
+	return res;
+}();
+
+
+static constexpr std::array<std::array<uint16_t, 256>, 8> _crc16_tables = []() {
+	std::array<std::array<uint16_t, 256>, 8> res{};
+	for (size_t i = 0; i < 256; ++i) {
+		auto crc = (uint16_t)(i << 8);
+		for (uint8_t j = 0; j < 8; ++j)
+			crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x8005) : (uint16_t)(crc << 1);
+		res[0][i] = crc;
+	}
+	// res[k][i] is the CRC of byte i followed by k zero bytes
+	for (size_t k = 1; k < res.size(); ++k)
+		for (size_t i = 0; i < 256; ++i)
+			res[k][i] = (uint16_t)(res[k - 1][i] << 8) ^ res[0][res[k - 1][i] >> 8];
+
+	return res;
+}();
+
+
+inline uint8_t crc8(const std::byte *data, size_t size, uint8_t crc)
+{   // O(N)
+	for (size_t i = 0; i < size; ++i)
+		crc = _crc8_table[crc ^ (uint8_t)data[i]];
+
+	return crc;
+}
+
+
+inline uint16_t crc16(const std::byte *data, size_t size, uint16_t crc)
+{   // O(N)
+	const auto &tables = _crc16_tables;
+	const auto *bytes = (const uint8_t *)data;
+	for (; size >= 8; bytes += 8, size -= 8) {
+		crc ^= (uint16_t)((bytes[0] << 8) | bytes[1]);
+		crc = tables[7][crc >> 8] ^ tables[6][crc & 0xff] ^ tables[5][bytes[2]] ^ tables[4][bytes[3]] ^
+				tables[3][bytes[4]] ^ tables[2][bytes[5]] ^ tables[1][bytes[6]] ^ tables[0][bytes[7]];
+	}
+	for (size_t i = 0; i < size; ++i)
+		crc = (uint16_t)(crc << 8) ^ tables[0][(crc >> 8) ^ bytes[i]];
+
+	return crc;
+}
+
+
+} // namespace crc
+} // namespace audio
+
+
+#endif // AUDIO_CRC
@@ -17,9 +17,35 @@
 #ifndef AUDIO_FLAC
 #define AUDIO_FLAC
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string_view>
+#include <thread>
 #include <vector>
 #include <basics/error.hh>
 #include <stream/bit.hh>
+#include "bit.hh"
+#include "buffer.hh"
+#include "crc.hh"
+#include "lpc.hh"
+#include "md5.hh"
+#include "memory.hh"
+#include "pcm.hh"
+#include "pool.hh"
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
 
 
 /*******************************************************************************************************
@@ -33,8 +59,131 @@
  * after the call to decode_marker(), *has_metadata* after reading all metadata entries by successive
  * calls to decode_metadata() and *complete* after all audio blocks are decoded by repeated calls to
  * decode_audio(). The streaminfo() member function returns a reference to the flac stream information
- * member if decoder state is either *has_metadata* or *complete*. No more than block_size() samples can
- * be extracted from the member buffer pointed to by block_data() after each call to decode_audio().
+ * member if decoder state is either *has_metadata* or *complete*. After each call to decode_audio(),
+ * block_data() returns a planar view of block_size() samples per channel over the member buffer, a
+ * single cache line aligned allocation holding one BUFFER_SIZE plane for each of up to
+ * MAX_CHANNEL_COUNT channels, 8 by default as in FLAC itself; stereo-only builds may set 2. Samples are
+ * stored as SAMPLE_TYPE, int32_t by default, which holds every FLAC bit depth; the 33-bit side channel
+ * of 32-bit stereo streams goes through an internal 64-bit buffer instead. A decoder constructed from a
+ * streaminfo starts in state *has_metadata*, reading frames from the first byte of istream; position()
+ * returns the byte offset of the next frame.
+ *
+ * Each frame header carries its own sample rate and the number of its first sample, or of its frame in
+ * fixed block size streams, so that block_sample_rate() and block_sample_number() describe the block
+ * just decoded even in streams whose rate or block size vary; a coded number that isn't valid UTF-8
+ * throws as a protocol error.
+ *
+ * Once the STREAMINFO is known, 16 and 24-bit mono and stereo frames are decoded by instances of the
+ * subframe loop specialized for that format: the channel loop has a constant trip count, the 33-bit
+ * side channel path compiles away and subframes without wasted bits have their sample bit size folded
+ * into the warm-up, VERBATIM and LPC paths. Other formats, and frames whose header disagrees with the
+ * STREAMINFO bit depth, go through the generic loop.
+ *
+ * The reset() member functions start a decoder over on another istream, as the constructors do, but
+ * keep its buffers: a worker decoding many short streams allocates nothing past the first one. The
+ * verification setting is kept; MD5 verification is not. The buffers are allocated by ALLOCATOR, the
+ * cache line aligned_allocator by default; a pooled_allocator takes the buffers freed by the decoders
+ * previously destroyed on the same thread.
+ *
+ * Decoders over a memory::input stream can seek() to any sample once the metadata is decoded. A
+ * SEEKTABLE narrows the search to the bytes between two seek points; the remaining range is bisected
+ * on frames found by find_frame() that decode and are followed by another frame header, down to a few
+ * frames, which are then decoded forward. The next decode_audio() returns the rest of the block holding
+ * the target sample, starting with it. The seektable() member function returns the stream seek points.
+ *
+ * decode_metadata() only parses STREAMINFO and SEEKTABLE. It records the location of the VORBIS_COMMENT
+ * block and of every PICTURE block, and skips them and any other block without reading their bytes
+ * from memory streams, so that cover art doesn't delay the first frame. Decoders over a memory::input
+ * stream decode them on demand: vorbis_comment() and picture() return views of the stream bytes, as
+ * the audio::flac::decode_vorbis_comment() and decode_picture() functions do for any block data.
+ *
+ * After set_verification(true), every frame is checked against its header CRC-8 and its footer CRC-16,
+ * and a mismatch throws. Checks are off by default, costing trusted input a single branch per frame.
+ * Memory streams are checksummed in place once a frame is read; other streams keep a copy of the
+ * frame bytes as they are consumed.
+ *
+ * The streaminfo md5_signature member holds the MD5 digest of the whole stream as interleaved
+ * little-endian samples of whole bytes. After set_md5_verification(true), called before the first
+ * frame is decoded, each decoded block is packed that way and hashed on an md5::pipeline thread while
+ * decoding goes on; reaching state *complete* throws if the digest doesn't match a signature that is
+ * set. Seeking stops the verification.
+ *
+ * The INSTRUMENTATION policy is told about every decoding stage, subframe and residual. The default
+ * no_instrumentation hooks are empty and compile away. The decoder_counters policy accumulates the CPU
+ * cycles spent per decoder_stage (nanoseconds where there is no cycle counter), a histogram of the
+ * subframe types and orders, and the residual partition and escaped partition counts. Its counters
+ * can be read from any thread through instrumentation() while decoding goes on.
+ *
+ * The decode_audio_interleaved() member function decodes the next block straight to interleaved PCM of
+ * the given format in out, which must hold block_size() samples of every channel: stereo decorrelation
+ * is undone by the packing kernel itself rather than in a pass of its own over the member buffer. A
+ * shorter out throws and keeps the block decoded, so that a retry with a larger out still gets it.
+ * Integer formats at least as wide as the stream samples keep their values. A narrower format, e.g.
+ * int16 out of a 24-bit stream, gets them requantized with TPDF dither, and float32 gets them
+ * normalized to [-1, 1), both through pcm::convert() over the restored block.
+ *
+ * The read() member function is a pull interface for real-time callers: it writes the next frame_count
+ * interleaved samples of every channel to out and returns how many it wrote, fewer only at the end of
+ * the stream. Blocks that fit whole in out are decoded straight into it, as decode_audio_interleaved()
+ * does; the others are decoded to the member buffer and handed out across calls. Nothing is allocated.
+ * Calls to decode_audio() in between drop the part of the block not read yet.
+ *
+ * The audio::flac::frame_index class records the byte offset, first sample number and sample count of
+ * every frame. build() fills it in one pass of decode_audio() calls on a decoder at its first frame;
+ * serialize() returns a compact little-endian blob, 18 bytes per frame, that load() views back in
+ * constant time, e.g. from a mapped sidecar file. An index turns seek() into a binary search, and lets
+ * parallel_decoder split chunks on exact frame boundaries.
+ *
+ * The audio::flac::probe() function reads the STREAMINFO of a stream from its first bytes, without a
+ * decoder or any allocation, and walks the metadata block headers for the location of the SEEKTABLE,
+ * the VORBIS_COMMENT and the first PICTURE block, and of the first frame. It only reads the 4-byte
+ * header of the blocks it skips, so data only needs to span the metadata; blocks past its end are
+ * left unset, and so is the audio offset. The blocks it locates can then be read with
+ * decode_vorbis_comment() and decode_picture().
+ *
+ * The audio::flac::find_frame() function returns the offset of the first frame header at or after an
+ * offset of a byte span that passes the sync code, reserved value and CRC-8 checks.
+ *
+ * The audio::flac::parallel_decoder class template has the decoder interface over a byte span holding
+ * a whole stream. It splits the audio frames into chunks of about chunk_byte_size bytes and decodes
+ * them ahead on a thread pool, each worker resyncing on the first frame header of its chunk with a
+ * decoder of its own, reset onto every chunk so that its buffers are allocated once per thread. Blocks
+ * are returned in stream order; a chunk whose first frame doesn't follow the previous chunk, i.e. the
+ * worker synced on a false header, is decoded again on the calling thread. set_verification() applies
+ * to the chunks scheduled after the call; set_md5_verification() hashes the blocks in stream order.
+ *
+ * The audio::flac::stream_decoder class template decodes a stream pushed to it in pieces of any size,
+ * e.g. as received from a non-blocking socket, so that one thread can serve many live streams. feed()
+ * appends bytes, and try_decode() returns *need_data* until the next metadata or frame is whole, with
+ * nothing lost in between: *has_metadata* once the STREAMINFO is read, *has_block* once block_data()
+ * holds the next block and *complete* once finish() was called and every frame fed is decoded. Frame
+ * CRCs are always checked. A frame that fails to decode while the bytes fed already hold the next
+ * frame header, or would hold the largest frame the STREAMINFO allows, is corrupt: the decoder skips
+ * to the next valid frame header and carries on, counting the bytes it dropped. A stream_decoder
+ * constructed from a streaminfo joins a stream past its metadata, syncing on its first frame header.
+ *
+ * The audio::flac::batch_decoder class template decodes many whole streams in memory at once, e.g. the
+ * short files of a server workload. decode() runs its workers, the calling thread and thread_count - 1
+ * threads, over every stream of the batch, slice_frame_count frames at a time, and returns once all are
+ * decoded. Each worker owns a decoder, and with it the block buffers, that it resets onto the stream
+ * of every slice it takes, so nothing is allocated per stream. Workers queue the streams they work on
+ * and take the next slice of the latest one, while its frames are cached; idle workers steal the oldest
+ * stream of another worker. on_block is called with the worker decoder after each block, in stream
+ * order for each stream, possibly from several threads at once for distinct streams; on_error is
+ * called with the error of a stream that fails to decode, which is dropped. The first exception thrown
+ * by a callback stops the batch, and decode() rethrows it.
+ *
+ * The audio::flac::encoder class template writes a FLAC stream characterized by streaminfo to ostream,
+ * in blocks of streaminfo max_block_size samples, default_block_size if zero. encode_marker() and
+ * encode_metadata() write the marker and a lone STREAMINFO, with the frame sizes and the MD5 signature
+ * unset, as ostream can't be rewound to fill them in; the streaminfo() member function returns them
+ * as measured, and the sample count, once finish() has written the last frame. encode_audio() appends
+ * count samples of every channel of a planar view, and complete blocks are encoded on a thread pool
+ * while more samples come in. encode_frame() codes each channel as the cheapest of a CONSTANT, a
+ * VERBATIM, the best FIXED and the best LPC subframe. LPC predictors come from the autocorrelation of
+ * the Tukey windowed signal, by the Levinson-Durbin recursion, up to max_lpc_order taps; the order is
+ * picked from the prediction errors. Residuals are Rice coded with the partition order and parameters
+ * that minimize their estimated size. Stereo frames use the cheapest of the four channel assignments.
  *
  */
 
@@ -43,8 +192,9 @@ namespace audio {
 namespace flac {
 
 
-using buffer_sample_type = int64_t;
-using audio_data = std::vector<std::vector<buffer_sample_type>>;
+using buffer_sample_type = int32_t;
+template<typename SAMPLE_TYPE = buffer_sample_type>
+using audio_data = sample_view<const SAMPLE_TYPE>;
 
 struct streaminfo_type {  // 208 bytes
 	uint16_t min_block_size;
@@ -55,7 +205,13 @@ struct streaminfo_type {  // 208 bytes
 	uint8_t channel_count;
 	uint8_t sample_bit_size;
 	uint64_t sample_count;
-	// byte md5_signature[16];
+	md5::digest_type md5_signature;  // of the interleaved little-endian samples; zero if unset
+};
+
+struct seekpoint_type {  // 18 bytes
+	uint64_t sample_number;  // of the target frame's first sample; all ones for a placeholder
+	uint64_t byte_offset;    // of the target frame, from the first frame
+	uint16_t sample_count;   // in the target frame
 };
 
 enum class decoder_state {
@@ -65,73 +221,618 @@ enum class decoder_state {
 	complete,
 };
 
-static const size_t max_channel_count = 2;
+static const size_t max_channel_count = 8;
+
+
+enum class decoder_stage : uint8_t {
+	header,         // frame and subframe headers, warm-up samples and LPC coefficients
+	residual,       // Rice partitions, escaped ones included
+	restore,        // FIXED and LPC prediction
+	verbatim,       // CONSTANT and VERBATIM samples
+	decorrelation,  // stereo restoration, and PCM packing for decode_audio_interleaved()
+};
+
+static const size_t decoder_stage_count = 5;
+
+
+class no_instrumentation {  // the default decoder policy, compiled away
+public:
+	inline uint64_t now() const { return 0; }
+	inline uint64_t add_stage(decoder_stage, uint64_t) { return 0; }
+	inline void add_subframe(uint8_t) {}
+	inline void add_residual(uint16_t, uint16_t) {}
+	inline void add_frame(uint16_t) {}
+};
+
+
+class decoder_counters {  // decoder policy counting cycles per stage and subframes per type
+public:
+	decoder_counters();
+
+	inline uint64_t now() const;
+	inline uint64_t add_stage(decoder_stage stage, uint64_t start);  // returns the current tick
+	inline void add_subframe(uint8_t subframe_type);
+	inline void add_residual(uint16_t partition_count, uint16_t escape_count);
+	inline void add_frame(uint16_t block_size);
+	void reset();
+
+	// readable from any thread, while decoding
+	inline uint64_t cycles(decoder_stage stage) const;
+	inline uint64_t frame_count() const;
+	inline uint64_t sample_count() const;
+	inline uint64_t constant_count() const;
+	inline uint64_t verbatim_count() const;
+	inline uint64_t fixed_count(uint8_t order) const;
+	inline uint64_t lpc_count(uint8_t order) const;  // order in [1, lpc::max_order]
+	inline uint64_t partition_count() const;
+	inline uint64_t escape_count() const;
+
+private:
+	inline static void _add(std::atomic<uint64_t> &counter, uint64_t value);
+	inline static uint64_t _get(const std::atomic<uint64_t> &counter);
+
+	std::array<std::atomic<uint64_t>, decoder_stage_count> _cycles;
+	std::array<std::atomic<uint64_t>, 64> _subframe_counts;  // by subframe type code
+	std::atomic<uint64_t> _frame_count;
+	std::atomic<uint64_t> _sample_count;
+	std::atomic<uint64_t> _partition_count;
+	std::atomic<uint64_t> _escape_count;
+};
 
 
 template<typename INPUT_STREAM>
 streaminfo_type decode_metadata(INPUT_STREAM &istream);
 
 
-template<typename INPUT_STREAM, size_t BUFFER_SIZE = 8192>
+struct metadata_block_type {
+	size_t offset;  // of the block data, from the stream marker; 0 if there is no such block
+	uint32_t size;  // bytes
+};
+
+struct probe_type {
+	streaminfo_type streaminfo;
+	metadata_block_type seektable;
+	metadata_block_type vorbis_comment;
+	metadata_block_type picture;  // the first one
+	size_t audio_offset;          // of the first frame; 0 if the metadata runs past the probed bytes
+};
+
+probe_type probe(std::span<const std::byte> data);
+
+
+struct vorbis_comment_type {  // views of the block data
+	std::string_view vendor;
+	std::vector<std::string_view> comments;  // NAME=value
+};
+
+struct picture_type {  // views of the block data
+	uint32_t type;  // 3 for the front cover
+	std::string_view mime_type;
+	std::string_view description;
+	uint32_t width;
+	uint32_t height;
+	uint32_t color_depth;  // bits per pixel
+	uint32_t color_count;  // of indexed-color pictures, 0 otherwise
+	std::span<const std::byte> data;
+};
+
+vorbis_comment_type decode_vorbis_comment(std::span<const std::byte> data);  // of the block
+picture_type decode_picture(std::span<const std::byte> data);
+
+
+class frame_index;
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE = 8192, typename SAMPLE_TYPE = buffer_sample_type,
+						size_t MAX_CHANNEL_COUNT = max_channel_count,
+						typename INSTRUMENTATION = no_instrumentation,
+						typename ALLOCATOR = aligned_allocator<SAMPLE_TYPE>>
 class decoder {
 public:
 	using state_type = decoder_state;
+	using sample_type = SAMPLE_TYPE;
 
 	explicit decoder(INPUT_STREAM &istream);
+	decoder(INPUT_STREAM &istream, const streaminfo_type &streaminfo);
 
+	void reset(INPUT_STREAM &istream);
+	void reset(INPUT_STREAM &istream, const streaminfo_type &streaminfo);
 	void decode_marker();
 	void decode_metadata();
 	void decode_audio();
+	void decode_audio_interleaved(std::span<std::byte> out, pcm::format format);
+	size_t read(std::span<int32_t> out, size_t frame_count);  // interleaved; 0 once complete
+	void seek(uint64_t sample);  // memory::input streams only
+	void seek(uint64_t sample, const frame_index &index);
+	void set_verification(bool is_enabled);
+	void set_md5_verification(bool is_enabled);  // from the first frame on
 
 	inline const decoder_state &state() const;
 	inline const streaminfo_type &streaminfo() const;
+	inline const std::vector<seekpoint_type> &seektable() const;
+	inline const metadata_block_type &vorbis_comment_block() const;
+	inline const std::vector<metadata_block_type> &picture_blocks() const;
+	vorbis_comment_type vorbis_comment() const;  // memory::input streams only; empty if there is none
+	picture_type picture(size_t picture_idx) const;  // memory::input streams only
 	inline const uint32_t &block_sample_rate() const;
-	inline const audio_data &block_data() const;
+	inline uint64_t block_sample_number() const;
+	inline audio_data<SAMPLE_TYPE> block_data() const;
 	inline const uint16_t &block_size() const;
+	inline size_t position() const;
+	inline bool verification() const;
+	inline const INSTRUMENTATION &instrumentation() const;
 
 private:
-	inline void _decode_subframe(uint8_t sample_bit_size);
-	inline void _decode_subframe_fixed(uint8_t order, uint8_t sample_bit_size);
-	inline void _decode_subframe_lpc(uint8_t order, uint8_t sample_bit_size);
-	inline void _decode_residuals(uint8_t order);
-	inline void _restore_linear_prediction(const int16_t *coefficients, uint8_t order, uint8_t shift);
-	inline int64_t _get_rice_int(size_t bit_count);
-	inline uint16_t _get_block_size(uint8_t flags_4bit);
+	using _sample_allocator_type = default_init_allocator<ALLOCATOR>;  // decoding writes before reading
+	using _wide_allocator_type =
+				typename std::allocator_traits<_sample_allocator_type>::template rebind_alloc<int64_t>;
+
+	inline void _decode_frame();
+	inline void _pack_frame(std::byte *out, pcm::format format) const;
+	inline void _pack_block(std::byte *out, pcm::format format);
+	inline bool _is_converted(pcm::format format) const;
+	inline void _restore_frame();
+	inline void _interleave(int32_t *out, size_t offset, size_t count) const;
+	inline void _update_md5(bool is_restored);
+	inline void _assert_md5();
+	inline void _select_variant();
+	template<uint8_t CHANNEL_COUNT, uint8_t SAMPLE_BIT_SIZE>
+	void _decode_subframes(uint8_t sample_bit_size);
+	template<uint8_t SAMPLE_BIT_SIZE, typename T>
+	inline void _decode_subframe(T *samples, uint8_t sample_bit_size);
+	template<typename T>
+	inline void _decode_subframe_data(T *samples, uint8_t subframe_type, uint8_t sample_bit_size,
+																				uint8_t wasted_bits);
+	template<typename T>
+	inline void _decode_subframe_fixed(T *samples, uint8_t order, uint8_t sample_bit_size);
+	template<typename T>
+	inline void _decode_subframe_lpc(T *samples, uint8_t order, uint8_t sample_bit_size);
+	template<typename T>
+	inline void _decode_residuals(T *samples, uint8_t order);
+	template<typename T>
+	inline void _restore_wasted_bits(T *samples, uint8_t wasted_bits) const;
+	template<typename T>
+	inline void _restore_stereo(uint8_t channel_assignment, const T *side);
+	inline void _assert_order(uint8_t order) const;
+	inline void _assert_crc8(size_t frame_position, uint8_t crc) const;
+	inline void _assert_crc16(size_t frame_position, uint16_t crc) const;
+	inline void _assert_output_size(std::span<std::byte> out, pcm::format format) const;
+	inline void _assert_streaminfo() const;
+	inline void _assert_seekable(uint64_t sample);
+	inline size_t _sync(size_t offset, size_t limit);
+	inline void _seek_forward(size_t position, uint64_t sample);
+	inline SAMPLE_TYPE *_channel_data(uint8_t channel_idx);
+	inline uint64_t _get_coded_number(uint8_t max_byte_count);
+	inline uint32_t _get_block_size(uint8_t flags_4bit);
 	inline uint32_t _get_sample_rate(uint8_t flags_4bit);
 	inline uint8_t _get_sample_bit_size(uint8_t flags_3bit);
 
-	stream::bit::input<INPUT_STREAM> _istream;
+	bit::input<INPUT_STREAM> _istream;
 	state_type _state;
 	streaminfo_type _streaminfo;
 	uint64_t _sample_count;
 	uint16_t _block_size;
 	uint32_t _block_sample_rate;
-	uint8_t _channel_idx;
 	uint64_t _frame_count;
-	int16_t _coefficients[32];
-	audio_data _buffer;
+	std::vector<seekpoint_type> _seektable;
+	metadata_block_type _vorbis_comment;
+	std::vector<metadata_block_type> _pictures;
+	size_t _first_frame_position;
+	uint64_t _block_sample_number;
+	size_t _block_offset;     // of the first sample past the seek target
+	bool _is_block_pending;   // decoded by seek(), returned by the next decode_audio()
+	size_t _read_count;       // block samples not returned by read() yet
+	uint8_t _channel_assignment;
+	bool _is_wide_side;       // the side channel is in _wide_buffer
+	void (decoder::*_decode_variant)(uint8_t);  // _decode_subframes() for the STREAMINFO format
+	bool _is_verifying;       // frame CRCs are checked
+	std::unique_ptr<md5::pipeline> _md5;  // hashing the decoded samples, if verifying
+	int32_t _coefficients[lpc::max_order];
+	pcm::dither _dither;      // for requantized output
+	[[no_unique_address]] INSTRUMENTATION _instrumentation;
+	std::vector<SAMPLE_TYPE, _sample_allocator_type> _buffer;  // planar, _channel_stride apart
+	std::vector<int64_t, _wide_allocator_type> _wide_buffer;
+
+	static constexpr size_t _channel_stride = aligned_stride<SAMPLE_TYPE>(BUFFER_SIZE);
 };
 
 
-/******************************************************************************************************/
+inline size_t find_frame(std::span<const std::byte> data, size_t offset,
+																	const streaminfo_type &streaminfo);
 
 
-/*
- * Limitations: * decodes only stereo streams
- *              * decoder doesn't attempt to resync, thus cannot seek
- */
+struct frame_type {  // 18 bytes serialized
+	uint64_t byte_offset;    // from the start of the decoder stream
+	uint64_t sample_number;  // of the first sample
+	uint16_t sample_count;
+};
 
 
-static constexpr const char *_decoder_name = "audio::flac::decoder";
-static constexpr int16_t _fixed_prediction_coefficients[5][4] = {
-	{},
-	{1},
-	{2, -1},
-	{3, -3, 1},
-	{4, -6, 4, -1},
+class frame_index {
+public:
+	frame_index();
+	frame_index(frame_index &&) = default;
+	frame_index &operator=(frame_index &&) = default;
+
+	template<typename DECODER>
+	static frame_index build(DECODER &decoder);
+	static frame_index load(std::span<const std::byte> blob);  // views blob; it must outlive the index
+
+	inline std::span<const std::byte> serialize() const;
+	inline size_t size() const;
+	inline frame_type operator[](size_t frame_idx) const;
+	inline size_t find(uint64_t sample) const;            // frame holding sample, size() if none
+	inline size_t find_offset(size_t byte_offset) const;  // first frame at or after byte_offset
+
+private:
+	std::vector<std::byte> _storage;
+	std::span<const std::byte> _blob;  // _storage or a loaded blob
+	size_t _size;
+};
+
+
+static const size_t default_chunk_byte_size = 256 * 1024;
+
+
+template<size_t BUFFER_SIZE = 8192, typename SAMPLE_TYPE = buffer_sample_type,
+														size_t MAX_CHANNEL_COUNT = max_channel_count>
+class parallel_decoder {
+public:
+	using state_type = decoder_state;
+	using sample_type = SAMPLE_TYPE;
+
+	explicit parallel_decoder(std::span<const std::byte> data, size_t thread_count = 0,
+								size_t chunk_byte_size = default_chunk_byte_size);
+	parallel_decoder(std::span<const std::byte> data, const frame_index &index, size_t thread_count = 0,
+								size_t chunk_byte_size = default_chunk_byte_size);
+
+	void decode_marker();
+	void decode_metadata();
+	void decode_audio();
+	void set_verification(bool is_enabled);  // for the chunks scheduled from then on
+	void set_md5_verification(bool is_enabled);  // from the first block on
+
+	inline const decoder_state &state() const;
+	inline const streaminfo_type &streaminfo() const;
+	inline const uint32_t &block_sample_rate() const;
+	inline const uint64_t &block_sample_number() const;
+	inline audio_data<SAMPLE_TYPE> block_data() const;
+	inline const uint16_t &block_size() const;
+	inline bool verification() const;
+
+private:
+	using _decoder_type = decoder<memory::input, BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>;
+
+	struct _worker_type {  // one per thread, reset onto each chunk it decodes
+		memory::input istream{std::span<const std::byte>{}};
+		_decoder_type decoder{istream};
+	};
+
+	struct _block_type {
+		size_t sample_offset;  // into _chunk_type::samples
+		uint16_t size;
+		uint32_t sample_rate;
+		uint64_t sample_number;
+	};
+
+	struct _chunk_type {
+		size_t begin;  // byte offset of the first frame
+		size_t end;    // byte offset past the last frame
+		size_t limit;  // frames starting before it belong to the chunk
+		bool is_valid;
+		std::vector<_block_type> blocks;
+		std::vector<SAMPLE_TYPE> samples;  // planar per block
+	};
+
+	_chunk_type _decode_chunk(size_t offset, size_t limit, bool is_synced, bool is_verifying) const;
+	void _schedule();
+
+	std::span<const std::byte> _data;
+	memory::input _istream;
+	_decoder_type _decoder;  // metadata and chunk layout
+	thread_pool _pool;
+	const frame_index *_index;  // chunks start on indexed frames, if any
+	size_t _chunk_byte_size;
+	size_t _schedule_offset;
+	std::deque<std::future<_chunk_type>> _chunks;  // decoding ahead, in stream order
+	_chunk_type _chunk;
+	size_t _block_idx;
+	size_t _position;  // byte offset past the last consumed chunk
+	state_type _state;
+	uint16_t _block_size;
+	uint32_t _block_sample_rate;
+	uint64_t _block_sample_number;
+	const SAMPLE_TYPE *_block_data;
+	bool _is_verifying;
+	std::unique_ptr<md5::pipeline> _md5;
+};
+
+
+enum class feed_status {
+	need_data,     // until the next feed()
+	has_metadata,
+	has_block,
+	complete,
+};
+
+
+template<size_t BUFFER_SIZE = 8192, typename SAMPLE_TYPE = buffer_sample_type,
+														size_t MAX_CHANNEL_COUNT = max_channel_count>
+class stream_decoder {
+public:
+	using state_type = decoder_state;
+	using sample_type = SAMPLE_TYPE;
+
+	stream_decoder();
+	explicit stream_decoder(const streaminfo_type &streaminfo);  // past the metadata
+
+	void feed(std::span<const std::byte> data);
+	void finish();  // no more data to feed
+	feed_status try_decode();
+
+	inline const decoder_state &state() const;
+	inline const streaminfo_type &streaminfo() const;
+	inline const uint32_t &block_sample_rate() const;
+	inline uint64_t block_sample_number() const;
+	inline audio_data<SAMPLE_TYPE> block_data() const;
+	inline const uint16_t &block_size() const;
+	inline size_t buffered_byte_size() const;  // fed, not decoded yet
+	inline const uint64_t &skipped_byte_count() const;  // dropped while resyncing
+
+private:
+	using _decoder_type = decoder<memory::input, BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>;
+
+	feed_status _decode_metadata();
+	feed_status _decode_frame();
+	feed_status _need_data();
+	inline size_t _max_frame_size() const;
+
+	std::vector<std::byte> _data;  // fed bytes, decoded up to _offset
+	size_t _offset;
+	bool _is_fed;      // bytes were fed since try_decode() last returned need_data
+	bool _is_finished;
+	state_type _state;
+	streaminfo_type _streaminfo;
+	uint64_t _skipped_byte_count;
+	memory::input _istream;  // the bytes from _offset on
+	_decoder_type _decoder;
+
+	static constexpr size_t _max_header_size = 16;
+};
+
+
+static const size_t default_slice_frame_count = 16;
+
+
+template<size_t BUFFER_SIZE = 8192, typename SAMPLE_TYPE = buffer_sample_type,
+														size_t MAX_CHANNEL_COUNT = max_channel_count>
+class batch_decoder {
+public:
+	using decoder_type = decoder<memory::input, BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>;
+	using sample_type = SAMPLE_TYPE;
+	using block_handler_type = std::function<void(size_t stream_idx, const decoder_type &decoder)>;
+	using error_handler_type = std::function<void(size_t stream_idx, const basics::error &err)>;
+
+	explicit batch_decoder(size_t thread_count = 0,
+												size_t slice_frame_count = default_slice_frame_count);
+
+	void decode(std::span<const std::span<const std::byte>> streams, const block_handler_type &on_block,
+																	const error_handler_type &on_error);
+	void set_verification(bool is_enabled);
+
+	inline size_t thread_count() const;
+	inline bool verification() const;
+
+private:
+	struct _stream_type {
+		std::span<const std::byte> data;
+		size_t position;  // of the next frame; 0 before the metadata
+		streaminfo_type streaminfo;
+	};
+
+	struct _worker_type {
+		_worker_type();
+
+		std::mutex mutex;
+		std::deque<size_t> streams;  // the owner takes the back, thieves the front
+		memory::input istream;       // the bytes of the current slice
+		decoder_type decoder;
+	};
+
+	void _work(size_t worker_idx);
+	bool _take(size_t worker_idx, size_t &stream_idx);
+	bool _decode_slice(_worker_type &worker, size_t stream_idx);  // false once the stream is done
+	void _stop(std::exception_ptr exception);
+
+	size_t _slice_frame_count;
+	bool _is_verifying;
+	std::vector<std::unique_ptr<_worker_type>> _workers;
+	std::vector<_stream_type> _streams;
+	const block_handler_type *_on_block;
+	const error_handler_type *_on_error;
+	std::atomic<size_t> _pending_count;  // streams not done yet
+	std::atomic<uint64_t> _push_count;   // waited on by idle workers
+	std::atomic<bool> _is_stopping;
+	std::mutex _exception_mutex;
+	std::exception_ptr _exception;       // the first one thrown by a callback
+};
+
+
+static const uint16_t default_block_size = 4096;
+static const uint8_t default_lpc_order = 8;
+
+
+std::vector<std::byte> encode_frame(const sample_view<const int32_t> &planar,
+											const streaminfo_type &streaminfo, uint64_t frame_number,
+																				uint8_t max_lpc_order);
+
+
+template<typename OUTPUT_STREAM>
+class encoder {
+public:
+	encoder(OUTPUT_STREAM &ostream, const streaminfo_type &streaminfo, size_t thread_count = 0,
+														uint8_t max_lpc_order = default_lpc_order);
+
+	void encode_marker();
+	void encode_metadata();
+	template<typename T>
+	void encode_audio(const sample_view<T> &planar, size_t count);
+	void finish();
+
+	inline const streaminfo_type &streaminfo() const;
+
+private:
+	void _submit();
+	void _write_frame();
+	void _write(const std::byte *data, size_t size);
+	inline void _assert_streaminfo() const;
+
+	OUTPUT_STREAM &_ostream;
+	streaminfo_type _streaminfo;
+	uint8_t _max_lpc_order;
+	thread_pool _pool;
+	std::deque<std::future<std::vector<std::byte>>> _frames;  // encoding ahead, in stream order
+	std::vector<int32_t> _block;  // planar, max_block_size apart
+	uint16_t _block_size;         // samples per channel in _block
+	uint64_t _frame_count;
+	uint64_t _sample_count;
 };
 
 
+/******************************************************************************************************/
+
+
+static constexpr const char *_decoder_name = "audio::flac::decoder";
+
+
+inline uint64_t decoder_counters::now() const
+{   // CPU cycles where a counter is at hand, nanoseconds otherwise
+#if defined(__x86_64__)
+	return __rdtsc();
+#elif defined(__aarch64__)
+	uint64_t res;
+	asm volatile("mrs %0, cntvct_el0" : "=r"(res));
+
+	return res;
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+									std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+
+inline uint64_t decoder_counters::add_stage(decoder_stage stage, uint64_t start)
+{
+	const auto res = now();
+	_add(_cycles[(size_t)stage], res - start);
+
+	return res;
+}
+
+
+inline void decoder_counters::add_subframe(uint8_t subframe_type)
+{
+	_add(_subframe_counts[subframe_type & 0x3f], 1);
+}
+
+
+inline void decoder_counters::add_residual(uint16_t partition_count, uint16_t escape_count)
+{
+	_add(_partition_count, partition_count);
+	_add(_escape_count, escape_count);
+}
+
+
+inline void decoder_counters::add_frame(uint16_t block_size)
+{
+	_add(_frame_count, 1);
+	_add(_sample_count, block_size);
+}
+
+
+inline uint64_t decoder_counters::cycles(decoder_stage stage) const
+{
+	return _get(_cycles[(size_t)stage]);
+}
+
+
+inline uint64_t decoder_counters::frame_count() const
+{
+	return _get(_frame_count);
+}
+
+
+inline uint64_t decoder_counters::sample_count() const
+{
+	return _get(_sample_count);
+}
+
+
+inline uint64_t decoder_counters::constant_count() const
+{
+	return _get(_subframe_counts[0]);
+}
+
+
+inline uint64_t decoder_counters::verbatim_count() const
+{
+	return _get(_subframe_counts[1]);
+}
+
+
+inline uint64_t decoder_counters::fixed_count(uint8_t order) const
+{
+	return (order <= lpc::max_fixed_order) ? _get(_subframe_counts[8 + order]) : 0;
+}
+
+
+inline uint64_t decoder_counters::lpc_count(uint8_t order) const
+{
+	return ((order >= 1) && (order <= lpc::max_order)) ? _get(_subframe_counts[31 + order]) : 0;
+}
+
+
+inline uint64_t decoder_counters::partition_count() const
+{
+	return _get(_partition_count);
+}
+
+
+inline uint64_t decoder_counters::escape_count() const
+{
+	return _get(_escape_count);
+}
+
+
+inline void decoder_counters::_add(std::atomic<uint64_t> &counter, uint64_t value)
+{   // a plain add: the decoder thread is the only writer
+	counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+
+inline uint64_t decoder_counters::_get(const std::atomic<uint64_t> &counter)
+{
+	return counter.load(std::memory_order_relaxed);
+}
+
+
+inline pcm::format _md5_format(uint8_t sample_bit_size)
+{
+	// whole bytes per sample, sign-extended, as hashed by encoders
+	return (pcm::format)((sample_bit_size + 7) / 8 * 8);
+}
+
+
+inline void _assert_md5_signature(const md5::digest_type &digest, const streaminfo_type &streaminfo)
+{
+	if (streaminfo.md5_signature == md5::digest_type{})  // not computed by the encoder
+		return;
+	if (digest != streaminfo.md5_signature)
+		throw basics::error{"%s: (protocol error) decoded audio doesn't match the MD5 signature",
+																						_decoder_name};
+}
+
+
 template<typename INPUT_STREAM>
 streaminfo_type decode_metadata(INPUT_STREAM &istream)
 {
@@ -161,8 +862,9 @@ streaminfo_type decode_metadata(INPUT_STREAM &istream)
 			res.channel_count   = bit_istream.get_uint(3) + 1;
 			res.sample_bit_size = bit_istream.get_uint(5) + 1;
 			res.sample_count    = bit_istream.get_uint(36);
+			for (auto &byte: res.md5_signature)
+				byte = bit_istream.get_uint(8);
 
-			// other bytes ignored
 			return res;
 		} else {  // OTHER METADATA BLOCKS
 			for (; metadata_byte_size > 0; --metadata_byte_size)
@@ -177,18 +879,83 @@ streaminfo_type decode_metadata(INPUT_STREAM &istream)
 }
 
 
-template<typename INPUT_STREAM, size_t BUFFER_SIZE>
-decoder<INPUT_STREAM, BUFFER_SIZE>::decoder(INPUT_STREAM &upstream)
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+						MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::decoder(INPUT_STREAM &upstream)
 	: _istream{upstream}, _state{state_type::init}, _streaminfo{},
-	  _sample_count{0}, _block_size{0}, _block_sample_rate{0}, _channel_idx{0},
-	  _frame_count{}, _coefficients{},
-	  _buffer(max_channel_count, std::vector<buffer_sample_type>(BUFFER_SIZE, 0))
+	  _sample_count{0}, _block_size{0}, _block_sample_rate{0}, _frame_count{}, _seektable{},
+	  _vorbis_comment{}, _pictures{}, _first_frame_position{0}, _block_sample_number{0},
+	  _block_offset{0}, _is_block_pending{false}, _read_count{0}, _channel_assignment{0},
+	  _is_wide_side{false}, _decode_variant{&decoder::_decode_subframes<0, 0>}, _is_verifying{false},
+	  _md5{}, _coefficients{}, _dither{}, _instrumentation{},
+	  _buffer(_channel_stride * MAX_CHANNEL_COUNT),
+	  _wide_buffer(sizeof(SAMPLE_TYPE) < sizeof(int64_t) ? BUFFER_SIZE : 0)
+{
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+						MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::decoder(INPUT_STREAM &upstream,
+																const streaminfo_type &streaminfo)
+	: decoder{upstream}
 {
+	_streaminfo = streaminfo;
+	_assert_streaminfo();
+	_select_variant();
+	_state = state_type::has_metadata;
 }
 
 
-template<typename INPUT_STREAM, size_t BUFFER_SIZE>
-void decoder<INPUT_STREAM, BUFFER_SIZE>::decode_marker()
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+void decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+						MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::reset(INPUT_STREAM &upstream)
+{   // keeps the buffers and the verification setting; drops MD5 verification
+	std::destroy_at(&_istream);
+	std::construct_at(&_istream, upstream);
+	_state = state_type::init;
+	_streaminfo = {};
+	_sample_count = 0;
+	_block_size = 0;
+	_block_sample_rate = 0;
+	_frame_count = 0;
+	_seektable.clear();
+	_vorbis_comment = {};
+	_pictures.clear();
+	_first_frame_position = 0;
+	_block_sample_number = 0;
+	_block_offset = 0;
+	_is_block_pending = false;
+	_read_count = 0;
+	_channel_assignment = 0;
+	_is_wide_side = false;
+	_decode_variant = &decoder::_decode_subframes<0, 0>;
+	_md5.reset();
+	_istream.record(_is_verifying);
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+void decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+						MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::reset(INPUT_STREAM &upstream,
+																	const streaminfo_type &streaminfo)
+{
+	reset(upstream);
+	_streaminfo = streaminfo;
+	_assert_streaminfo();
+	_select_variant();
+	_state = state_type::has_metadata;
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+void decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+										MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::decode_marker()
 {
 	if (_istream.get_uint(32) != 0x664c6143)
 		throw basics::error{"%s: (protocol error) unexpected marker", _decoder_name};
@@ -197,8 +964,10 @@ void decoder<INPUT_STREAM, BUFFER_SIZE>::decode_marker()
 }
 
 
-template<typename INPUT_STREAM, size_t BUFFER_SIZE>
-void decoder<INPUT_STREAM, BUFFER_SIZE>::decode_metadata()
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+void decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+									MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::decode_metadata()
 {
 	// METADATA_BLOCK_HEADER <32>
 	if (_istream.get_uint(1) == 1)
@@ -218,224 +987,748 @@ void decoder<INPUT_STREAM, BUFFER_SIZE>::decode_metadata()
 		_streaminfo.sample_bit_size = _istream.get_uint(5) + 1;
 		_streaminfo.sample_count    = _istream.get_uint(36);
 
-		if (_streaminfo.channel_count > max_channel_count)
-			throw basics::error{"%s: (assertion failed) expecting maximum %zu channels; got %u",
-										_decoder_name, max_channel_count, _streaminfo.channel_count};
-		if (_streaminfo.max_block_size > BUFFER_SIZE)
-			throw basics::error{"%s: (assertion failed) expecting maximum %zu samples/block; got %u",
-											_decoder_name, BUFFER_SIZE, _streaminfo.max_block_size};
-
-		for (auto i = uint8_t{0}; i < 16; ++i)
-			_istream.get_byte();
-	} else {  // OTHER METADATA BLOCKS
-		for (; metadata_byte_size > 0; --metadata_byte_size)
-			_istream.get_byte();
+		_assert_streaminfo();
+		_select_variant();
+
+		for (auto &byte: _streaminfo.md5_signature)
+			byte = _istream.get_byte();
+	} else if (metadata_type_id == 3) {  // SEEKTABLE
+		_seektable.resize(metadata_byte_size / 18);
+		for (auto &point: _seektable) {
+			point.sample_number = _istream.get_uint(64);
+			point.byte_offset   = _istream.get_uint(64);
+			point.sample_count  = _istream.get_uint(16);
+		}
+		_istream.skip(metadata_byte_size % 18);
+	} else {  // OTHER METADATA BLOCKS, decoded on demand
+		if ((metadata_type_id == 4) && (_vorbis_comment.offset == 0))
+			_vorbis_comment = {_istream.position(), (uint32_t)metadata_byte_size};
+		else if (metadata_type_id == 6)
+			_pictures.push_back({_istream.position(), (uint32_t)metadata_byte_size});
+
+		_istream.skip(metadata_byte_size);
 	}
+
+	if (_state == state_type::has_metadata)
+		_first_frame_position = _istream.position();
 }
 
 
-template<typename INPUT_STREAM, size_t BUFFER_SIZE>
-void decoder<INPUT_STREAM, BUFFER_SIZE>::decode_audio()
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+void decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+										MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::decode_audio()
 {   // O(N)
+	_read_count = 0;
+	if (_is_block_pending) {
+		_is_block_pending = false;
+
+		return;
+	}
+
+	_block_offset = 0;
 	if (_istream.eos()) {
 		_state = state_type::complete;
+		_assert_md5();
 
 		return;
 	}
 
-	if (_streaminfo.channel_count > max_channel_count)
-		throw basics::error{"%s: (assertion failed) cannot decode more than %u channels; got %u",
-														max_channel_count, _streaminfo.channel_count};
+	_decode_frame();
+	_restore_frame();
+	if (_md5)
+		_update_md5(true);
+}
 
 
-	// FRAME_HEADER
-	const auto sync_code = _istream.get_uint(14);
-	if (sync_code != 0b11111111111110)
-		throw basics::error{"%s: (protocol error) unexpected frame sync code; got 0x%x, expecting 0x%x",
-															_decoder_name, sync_code, 0b11111111111110};
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+void decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+	MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::decode_audio_interleaved(std::span<std::byte> out,
+																					pcm::format format)
+{   // O(N)
+	_read_count = 0;
+	if (_is_block_pending) {  // already restored by seek() or by a call with too small an out
+		_assert_output_size(out, format);
+		_is_block_pending = false;
+		_pack_block(out.data(), format);
 
-	if (_istream.get_uint(1) != 0)
-		throw basics::error{"%s: (protocol error) unexpected frame reserved bit #1", _decoder_name};
+		return;
+	}
 
-	/*const auto block_strategy_bitset = (uint8_t)*/_istream.get_uint(1);
-	const auto block_size_bitset         = (uint8_t)_istream.get_uint(4);
-	const auto sample_rate_bitset        = (uint8_t)_istream.get_uint(4);
-	const auto channel_assignment_bitset = (uint8_t)_istream.get_uint(4);
-	const auto sample_bit_size_bitset    = (uint8_t)_istream.get_uint(3);
-	if (_istream.get_uint(1) != 0)
-		throw basics::error{"%s: (protocol error) unexpected frame reserved bit #2", _decoder_name};
+	_block_offset = 0;
+	if (_istream.eos()) {
+		_state = state_type::complete;
+		_assert_md5();
 
-	const auto extra_byte_len = stream::bit::countl_zero<uint8_t>(~(uint8_t)_istream.get_uint(8)) - 1;
-	for (int i = 0; i < extra_byte_len; ++i)
-		_istream.get_uint(8);
+		return;
+	}
 
-	_block_size = _get_block_size(block_size_bitset);
-	_block_sample_rate = _get_sample_rate(sample_rate_bitset);
-	const auto sample_bit_size = _get_sample_bit_size(sample_bit_size_bitset);
+	_decode_frame();
+	if (out.size() < (size_t)_block_size * _streaminfo.channel_count * pcm::sample_byte_size(format)) {
+		_restore_frame();  // kept pending, so that a retry with a larger out gets this block
+		if (_md5)
+			_update_md5(true);
+		_is_block_pending = true;
+		_assert_output_size(out, format);
+	}
+	if (_is_converted(format)) {
+		_restore_frame();
+		const auto tick = _instrumentation.now();
+		_pack_block(out.data(), format);
+		_instrumentation.add_stage(decoder_stage::decorrelation, tick);
+		if (_md5)
+			_update_md5(true);
 
-	_istream.get_uint(8);  // CRC-8 polynomial
+		return;
+	}
 
-	// SUBFRAME+
-	if (channel_assignment_bitset < 8) {  // independent channel encoding
-		for (_channel_idx = 0; _channel_idx < _streaminfo.channel_count; ++_channel_idx) {
-			_buffer[_channel_idx].resize(_block_size);
+	const auto tick = _instrumentation.now();
+	_pack_frame(out.data(), format);
+	_instrumentation.add_stage(decoder_stage::decorrelation, tick);
+	if (_md5)
+		_update_md5(false);
+}
 
-			_decode_subframe(sample_bit_size);
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+size_t decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+							MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::read(std::span<int32_t> out,
+																					size_t frame_count)
+{   // O(frame_count); allocation free
+	const auto channel_count = _streaminfo.channel_count;
+	if (out.size() < frame_count * channel_count)
+		throw basics::error{"%s: (assertion failed) expecting an output of at least %zu samples; "
+									"got %zu", _decoder_name, frame_count * channel_count, out.size()};
+
+	size_t res{0};
+	while (res < frame_count) {
+		if (_read_count > 0) {  // the rest of the current block
+			const auto count = std::min(_read_count, frame_count - res);
+			_interleave(out.data() + res * channel_count, _block_size - _read_count, count);
+			_read_count -= count;
+			res += count;
+			continue;
 		}
-	} else if (channel_assignment_bitset < 11) {  // correlated channel encoding
-		// if (_streaminfo.channel_count != 2)
-		// 	throw basics::error{"%s: (protocol error) correlated channel encoding for non-stereo;"
-		// 							"expecting 2, got %u channels", _streaminfo.channel_count};
-
-		_channel_idx = 0;
-		_buffer[_channel_idx].resize(_block_size);
-		_decode_subframe(sample_bit_size + ((channel_assignment_bitset == 9) ? 1 : 0));
-
-		_channel_idx = 1;
-		_buffer[_channel_idx].resize(_block_size);
-		_decode_subframe(sample_bit_size + ((channel_assignment_bitset == 9) ? 0 : 1));
-
-		// side=left-right; mid=left+right;
-		if (channel_assignment_bitset == 8) {          // left-side:  ch0=left, ch1=side
-			for (uint16_t i = 0; i < _block_size; ++i)
-				_buffer[1][i] = _buffer[0][i] - _buffer[1][i];
-		} else if (channel_assignment_bitset == 9) {   // right-side: ch0=side, ch1=right
-			for (uint16_t i = 0; i < _block_size; ++i)
-				_buffer[0][i] += _buffer[1][i];
-		} else if (channel_assignment_bitset == 10) {  // mid-side:   ch0=mid,  ch1=side
-			buffer_sample_type mid{};
-			// buffer_sample_type side{};
-			for (uint16_t i = 0; i < _block_size; ++i) {
-				mid = (uint64_t)_buffer[0][i] << 1;
-				// side = _buffer[1][i];
-				mid |= _buffer[1][i] & 1;  // odd side
-				_buffer[0][i] = (mid + _buffer[1][i]) >> 1;
-				_buffer[1][i] = (mid - _buffer[1][i]) >> 1;
-			}
+
+		// whole blocks that fit go straight to out, decorrelated while interleaving
+		const auto is_direct = (std::endian::native == std::endian::little) && !_is_block_pending &&
+				(_streaminfo.max_block_size > 0) && (frame_count - res >= _streaminfo.max_block_size);
+		if (is_direct) {
+			decode_audio_interleaved(std::as_writable_bytes(out.subspan(res * channel_count)),
+																					pcm::format::int32);
+			if (_state == state_type::complete)
+				break;
+			res += _block_size;
+		} else {
+			decode_audio();
+			if (_state == state_type::complete)
+				break;
+			_read_count = _block_size;
 		}
-	} else
+	}
+
+	return res;
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline void decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+							MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::_interleave(int32_t *out,
+																	size_t offset, size_t count) const
+{   // O(count*channel_count); from sample offset of block_data()
+	const auto data = block_data();
+	if constexpr (std::endian::native == std::endian::little) {
+		const auto view = audio_data<SAMPLE_TYPE>{data.data() + offset, data.stride(),
+																		data.channel_count(), count};
+		pcm::pack((std::byte *)out, view, count, pcm::format::int32);
+	} else {
+		for (size_t i = offset; i < offset + count; ++i)
+			for (uint8_t channel_idx = 0; channel_idx < data.channel_count(); ++channel_idx)
+				*out++ = data[channel_idx][i];
+	}
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline void decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+							MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::_pack_frame(std::byte *out,
+																		pcm::format format) const
+{   // O(N); packs the channels as decoded by _decode_frame()
+	if (_channel_assignment < 8)
+		return pcm::pack(out, block_data(), _block_size, format);
+
+	// undo stereo decorrelation while interleaving; 8, 9, 10 map to left_side, side_right, mid_side
+	const auto coding = (pcm::stereo_coding)(_channel_assignment - 7);
+	const auto *left = _buffer.data();
+	const auto *right = _buffer.data() + _channel_stride;
+	if (!_is_wide_side)
+		pcm::pack_stereo(out, left, right, _block_size, coding, format);
+	else if (_channel_assignment == 9)
+		pcm::pack_stereo(out, _wide_buffer.data(), right, _block_size, coding, format);
+	else
+		pcm::pack_stereo(out, left, _wide_buffer.data(), _block_size, coding, format);
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline void decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+		MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::_pack_block(std::byte *out, pcm::format format)
+{   // O(N); packs the restored block
+	if (_is_converted(format))
+		pcm::convert(out, block_data(), _block_size, _streaminfo.sample_bit_size, format, _dither);
+	else
+		pcm::pack(out, block_data(), _block_size, format);
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline bool decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+				MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::_is_converted(pcm::format format) const
+{
+	return (format == pcm::format::float32) || ((uint8_t)format < _streaminfo.sample_bit_size);
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline void decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+										MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::_restore_frame()
+{   // O(N); undoes the stereo decorrelation in the member buffer
+	if (_channel_assignment < 8)
+		return;
+
+	const auto tick = _instrumentation.now();
+	if (_is_wide_side)
+		_restore_stereo(_channel_assignment, _wide_buffer.data());
+	else
+		_restore_stereo(_channel_assignment, _channel_data((_channel_assignment == 9) ? 0 : 1));
+	_instrumentation.add_stage(decoder_stage::decorrelation, tick);
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline void decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+						MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::_update_md5(bool is_restored)
+{   // O(N); hashing runs on the pipeline thread
+	const auto format = _md5_format(_streaminfo.sample_bit_size);
+	const auto byte_size = (size_t)_block_size * _streaminfo.channel_count *
+																		pcm::sample_byte_size(format);
+	auto out = _md5->buffer(byte_size);
+	if (is_restored)
+		pcm::pack(out.data(), block_data(), _block_size, format);
+	else
+		_pack_frame(out.data(), format);
+	_md5->submit();
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline void decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+										MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::_assert_md5()
+{
+	if (!_md5)
+		return;
+
+	const auto digest = _md5->digest();
+	_md5.reset();
+	_assert_md5_signature(digest, _streaminfo);
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline void decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+										MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::_decode_frame()
+{   // O(N); leaves correlated channels as coded
+	const auto frame_position = _istream.position();
+	const auto tick = _instrumentation.now();
+
+	// FRAME_HEADER
+	const auto sync_code = _istream.get_uint(14);
+	if (sync_code != 0b11111111111110)
+		throw basics::error{"%s: (protocol error) unexpected frame sync code; got 0x%x, expecting 0x%x",
+															_decoder_name, sync_code, 0b11111111111110};
+
+	if (_istream.get_uint(1) != 0)
+		throw basics::error{"%s: (protocol error) unexpected frame reserved bit #1", _decoder_name};
+
+	const auto block_strategy_bitset     = (uint8_t)_istream.get_uint(1);
+	const auto block_size_bitset         = (uint8_t)_istream.get_uint(4);
+	const auto sample_rate_bitset        = (uint8_t)_istream.get_uint(4);
+	const auto channel_assignment_bitset = (uint8_t)_istream.get_uint(4);
+	const auto sample_bit_size_bitset    = (uint8_t)_istream.get_uint(3);
+	if (_istream.get_uint(1) != 0)
+		throw basics::error{"%s: (protocol error) unexpected frame reserved bit #2", _decoder_name};
+
+	// frame number <31>, or sample number <36> for variable block size streams
+	_block_sample_number = (block_strategy_bitset == 1) ?
+							_get_coded_number(7) : _get_coded_number(6) * _streaminfo.max_block_size;
+
+	const auto block_size = _get_block_size(block_size_bitset);
+	const auto max_block_size = (_streaminfo.max_block_size > 0) ?
+					std::min<uint32_t>(_streaminfo.max_block_size, BUFFER_SIZE) : (uint32_t)BUFFER_SIZE;
+	if (block_size > max_block_size)
+		throw basics::error{"%s: (protocol error) unexpected block size; expecting maximum %u, got %u",
+															_decoder_name, max_block_size, block_size};
+
+	_block_size = block_size;
+	_block_sample_rate = _get_sample_rate(sample_rate_bitset);
+	const auto sample_bit_size = _get_sample_bit_size(sample_bit_size_bitset);
+
+	const auto header_crc = (uint8_t)_istream.get_uint(8);  // CRC-8 polynomial
+	if (_is_verifying)
+		_assert_crc8(frame_position, header_crc);
+	_instrumentation.add_stage(decoder_stage::header, tick);
+
+	// SUBFRAME+
+	const auto channel_count = (channel_assignment_bitset < 8) ? channel_assignment_bitset + 1u : 2u;
+	if (channel_count != _streaminfo.channel_count)
+		throw basics::error{"%s: (protocol error) unexpected frame channel count; expecting %u, got %u",
+											_decoder_name, _streaminfo.channel_count, channel_count};
+
+	if (channel_assignment_bitset > 10)
 		throw basics::error{"%s: (assertion failed) unsupported channel assignment (%u)",
 															_decoder_name, channel_assignment_bitset};
 
+	_channel_assignment = channel_assignment_bitset;
+	if (sample_bit_size == _streaminfo.sample_bit_size)  // the channel count is checked above
+		(this->*_decode_variant)(sample_bit_size);
+	else
+		_decode_subframes<0, 0>(sample_bit_size);
+
 	_sample_count += _block_size;
 	++_frame_count;
+	_instrumentation.add_frame(_block_size);
 
 	_istream.align();  // zero padding to byte alignment
 
 	// FRAME FOOTER
-	_istream.get_uint(16);  // CRC-16 polynomial
+	if (!_is_verifying) {
+		_istream.get_uint(16);  // CRC-16 polynomial
+
+		return;
+	}
+
+	const auto footer_position = _istream.position();
+	const auto footer_crc = (uint16_t)_istream.get_uint(16);
+	_assert_crc16(frame_position, footer_crc);
+	_istream.release(footer_position + 2);
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+void decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+								MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::seek(uint64_t sample)
+{   // O(log N) frame decodes, then O(frame byte size)
+	static_assert(std::derived_from<INPUT_STREAM, memory::input>, "seeking needs random access input");
+
+	_assert_seekable(sample);
+
+	// the frame holding sample starts within [low, high); seek points narrow it down
+	auto low = _first_frame_position;
+	auto high = _istream.data().size();
+	for (const auto &point: _seektable) {
+		if (point.sample_number == ~uint64_t{0})  // placeholder
+			continue;
+		const auto point_position = _first_frame_position + point.byte_offset;
+		if (point.sample_number > sample) {
+			high = std::min(high, point_position);
+			break;
+		}
+		low = std::max(low, point_position);
+	}
+
+	// bisect down to a few frames, on frames that sync and decode
+	const auto span = std::max<size_t>(2 * _streaminfo.max_frame_size, 16 * 1024);
+	while (high - low > span) {
+		const auto middle = low + (high - low) / 2;
+		const auto position = _sync(middle, high);
+		if ((position < high) && (_block_sample_number <= sample))
+			low = position;
+		else
+			high = middle;
+	}
+
+	_seek_forward(low, sample);
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+void decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+								MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::seek(uint64_t sample,
+																			const frame_index &index)
+{   // O(log N), then O(frame byte size)
+	static_assert(std::derived_from<INPUT_STREAM, memory::input>, "seeking needs random access input");
+
+	_assert_seekable(sample);
+
+	const auto frame_idx = index.find(sample);
+	if (frame_idx == index.size())
+		throw basics::error{"%s: (protocol error) sample %lu not indexed", _decoder_name, sample};
+
+	_seek_forward(index[frame_idx].byte_offset, sample);
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+void decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+					MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::set_verification(bool is_enabled)
+{
+	// streams without random access keep the bytes of the current frame for the checks
+	_is_verifying = is_enabled;
+	_istream.record(is_enabled);
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+void decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+				MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::set_md5_verification(bool is_enabled)
+{
+	if (!is_enabled) {
+		_md5.reset();
+
+		return;
+	}
+
+	if ((_state != state_type::has_metadata) || (_frame_count > 0))
+		throw basics::error{"%s: (assertion failed) MD5 verification must start at the first frame",
+																						_decoder_name};
+
+	_md5 = std::make_unique<md5::pipeline>();
 }
 
 
-template<typename INPUT_STREAM, size_t BUFFER_SIZE>
-inline const decoder_state &decoder<INPUT_STREAM, BUFFER_SIZE>::state() const
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline const decoder_state &decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+										MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::state() const
 {
 	return _state;
 }
 
 
-template<typename INPUT_STREAM, size_t BUFFER_SIZE>
-inline const streaminfo_type &decoder<INPUT_STREAM, BUFFER_SIZE>::streaminfo() const
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline const streaminfo_type &decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+									MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::streaminfo() const
 {
 	return _streaminfo;
 }
 
 
-template<typename INPUT_STREAM, size_t BUFFER_SIZE>
-inline const audio_data &decoder<INPUT_STREAM, BUFFER_SIZE>::block_data() const
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline audio_data<SAMPLE_TYPE> decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+									MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::block_data() const
 {
-	return _buffer;
+	return {_buffer.data() + _block_offset, _channel_stride, _streaminfo.channel_count, _block_size};
 }
 
 
-template<typename INPUT_STREAM, size_t BUFFER_SIZE>
-inline const uint16_t &decoder<INPUT_STREAM, BUFFER_SIZE>::block_size() const
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline const uint16_t &decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+									MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::block_size() const
 {
 	return _block_size;
 }
 
 
-template<typename INPUT_STREAM, size_t BUFFER_SIZE>
-inline const uint32_t &decoder<INPUT_STREAM, BUFFER_SIZE>::block_sample_rate() const
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline const uint32_t &decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+							MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::block_sample_rate() const
 {
 	return _block_sample_rate;
 }
 
 
-template<typename INPUT_STREAM, size_t BUFFER_SIZE>
-inline void decoder<INPUT_STREAM, BUFFER_SIZE>::_decode_subframe(uint8_t sample_bit_size)
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline uint64_t decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+							MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::block_sample_number() const
+{
+	return _block_sample_number + _block_offset;
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline const std::vector<seekpoint_type> &decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+									MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::seektable() const
+{
+	return _seektable;
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline const metadata_block_type &decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+							MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::vorbis_comment_block() const
+{
+	return _vorbis_comment;
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline const std::vector<metadata_block_type> &decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+								MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::picture_blocks() const
+{
+	return _pictures;
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+vorbis_comment_type decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+								MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::vorbis_comment() const
+{
+	static_assert(std::derived_from<INPUT_STREAM, memory::input>,
+															"lazy metadata needs random access input");
+
+	if (_vorbis_comment.offset == 0)
+		return {};
+
+	return decode_vorbis_comment(_istream.bytes(_vorbis_comment.offset,
+														_vorbis_comment.offset + _vorbis_comment.size));
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+picture_type decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+					MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::picture(size_t picture_idx) const
+{
+	static_assert(std::derived_from<INPUT_STREAM, memory::input>,
+															"lazy metadata needs random access input");
+
+	if (picture_idx >= _pictures.size())
+		throw basics::error{"%s: (assertion failed) no picture %lu of %lu",
+														_decoder_name, picture_idx, _pictures.size()};
+
+	const auto &block = _pictures[picture_idx];
+
+	return decode_picture(_istream.bytes(block.offset, block.offset + block.size));
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline size_t decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+										MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::position() const
+{
+	return _istream.position();
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline bool decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+									MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::verification() const
+{
+	return _is_verifying;
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline const INSTRUMENTATION &decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+								MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::instrumentation() const
+{
+	return _instrumentation;
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline void decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+									MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::_select_variant()
+{   // the common formats get their own _decode_subframes() instance, the others the generic one
+	const auto channel_count = _streaminfo.channel_count;
+	const auto sample_bit_size = _streaminfo.sample_bit_size;
+	if ((channel_count == 2) && (sample_bit_size == 16))
+		_decode_variant = &decoder::_decode_subframes<2, 16>;
+	else if ((channel_count == 2) && (sample_bit_size == 24))
+		_decode_variant = &decoder::_decode_subframes<2, 24>;
+	else if ((channel_count == 1) && (sample_bit_size == 16))
+		_decode_variant = &decoder::_decode_subframes<1, 16>;
+	else if ((channel_count == 1) && (sample_bit_size == 24))
+		_decode_variant = &decoder::_decode_subframes<1, 24>;
+	else
+		_decode_variant = &decoder::_decode_subframes<0, 0>;
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+template<uint8_t CHANNEL_COUNT, uint8_t SAMPLE_BIT_SIZE>
+void decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+			MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::_decode_subframes(uint8_t sample_bit_size)
+{   // O(N); CHANNEL_COUNT and SAMPLE_BIT_SIZE as in the STREAMINFO, or 0 for those of the frame
+	static constexpr auto side_bit_size = (SAMPLE_BIT_SIZE > 0) ? SAMPLE_BIT_SIZE + 1 : 0;
+	if constexpr (SAMPLE_BIT_SIZE > 0)
+		sample_bit_size = SAMPLE_BIT_SIZE;
+
+	const auto channel_count = (CHANNEL_COUNT > 0) ? CHANNEL_COUNT : _streaminfo.channel_count;
+	_is_wide_side = (_channel_assignment >= 8) && (sample_bit_size + 1u > sizeof(SAMPLE_TYPE) * 8);
+	if ((CHANNEL_COUNT == 1) || (_channel_assignment < 8)) {  // independent channel encoding
+		for (uint8_t channel_idx = 0; channel_idx < channel_count; ++channel_idx)
+			_decode_subframe<SAMPLE_BIT_SIZE>(_channel_data(channel_idx), sample_bit_size);
+
+		return;
+	}
+
+	// correlated channel encoding
+	const auto side_idx = (_channel_assignment == 9) ? 0 : 1;
+	for (uint8_t channel_idx = 0; channel_idx < 2; ++channel_idx) {
+		if (channel_idx != side_idx)
+			_decode_subframe<SAMPLE_BIT_SIZE>(_channel_data(channel_idx), sample_bit_size);
+		else if (_is_wide_side)  // 33-bit side channel of a 32-bit stream
+			_decode_subframe<0>(_wide_buffer.data(), sample_bit_size + 1);
+		else
+			_decode_subframe<side_bit_size>(_channel_data(channel_idx), sample_bit_size + 1);
+	}
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+template<uint8_t SAMPLE_BIT_SIZE, typename T>
+inline void decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+							MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::_decode_subframe(T *samples,
+																				uint8_t sample_bit_size)
 {
+	auto tick = _instrumentation.now();
+
 	//  SUBFRAME_HEADER
 	_istream.get_uint(1); // zero padding (NOT ENFORCED)
 
 	auto subframe_type = (uint8_t)_istream.get_uint(6);
 
 	auto wasted_bits = uint8_t{0};
-	if (_istream.get_uint(1) == 1) {
-		for (;;) {
-			if (_istream.get_uint(1) == 1)
-				break;
-			++wasted_bits;
-		}
+	if (_istream.get_uint(1) == 1) {  // unary coded, k - 1 zero bits then a one
+		const auto count = _istream.get_unary() + 1;
+		if (count >= sample_bit_size)
+			throw basics::error{"%s: (protocol error) unexpected wasted bit count (%u of %ub)",
+														_decoder_name, count, sample_bit_size};
+		wasted_bits = count;
+	}
+	_instrumentation.add_subframe(subframe_type);
+	_instrumentation.add_stage(decoder_stage::header, tick);
+
+	if constexpr (SAMPLE_BIT_SIZE > 0) {
+		if (wasted_bits == 0)  // the common case, with the sample bit size folded in
+			return _decode_subframe_data(samples, subframe_type, SAMPLE_BIT_SIZE, 0);
 	}
-	sample_bit_size -= wasted_bits;
+	_decode_subframe_data(samples, subframe_type, sample_bit_size - wasted_bits, wasted_bits);
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+template<typename T>
+inline void decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+					MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::_decode_subframe_data(T *samples,
+									uint8_t subframe_type, uint8_t sample_bit_size, uint8_t wasted_bits)
+{
+	const auto tick = _instrumentation.now();
 
 	// SUBFRAME DATA
 	if (subframe_type == 0) {  // SUBFRAME_CONSTANT: O(N)
-		fill_n(_buffer[_channel_idx].begin(), _buffer[_channel_idx].size(),
-																	_istream.get_int(sample_bit_size));
+		std::fill_n(samples, _block_size, (T)(_istream.get_int(sample_bit_size) << wasted_bits));
+		_instrumentation.add_stage(decoder_stage::verbatim, tick);
+
+		return;
 	} else if (subframe_type == 1) {  // SUBFRAME_VERBATIM: O(N)
-		for (uint16_t i = 0; i < _buffer[_channel_idx].size(); ++i)
-			_buffer[_channel_idx][i] = _istream.get_int(sample_bit_size);
+		_istream.get_ints(samples, _block_size, sample_bit_size);
+		_instrumentation.add_stage(decoder_stage::verbatim, tick);
 	} else if (subframe_type < 8) {
 		throw basics::error{"%s: (protocol error) reserved subframe type 1(%u)",
 																		_decoder_name, subframe_type};
 	} else if (subframe_type < 13) {  // SUBFRAME_FIXED
-		_decode_subframe_fixed(subframe_type - 8, sample_bit_size);
+		_decode_subframe_fixed(samples, subframe_type - 8, sample_bit_size);
 	} else if (subframe_type < 32) {
 		throw basics::error{"%s: (protocol error) reserved subframe type 2(%u)",
 																		_decoder_name, subframe_type};
 	} else {  // SUBFRAME_LPC
-		_decode_subframe_lpc(subframe_type - 31, sample_bit_size);
+		_decode_subframe_lpc(samples, subframe_type - 31, sample_bit_size);
 	}
 
-	if (wasted_bits > 0)
-		for (auto sample: _buffer[_channel_idx])
-			sample <<= wasted_bits;
+	if (wasted_bits > 0)  // while the block is still cached
+		_restore_wasted_bits(samples, wasted_bits);
 }
 
 
-template<typename INPUT_STREAM, size_t BUFFER_SIZE>
-inline void decoder<INPUT_STREAM, BUFFER_SIZE>::_decode_subframe_fixed(uint8_t order,
-																				uint8_t sample_bit_size)
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+template<typename T>
+inline void decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+					MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::_decode_subframe_fixed(T *samples,
+																uint8_t order, uint8_t sample_bit_size)
 {
+	auto tick = _instrumentation.now();
+	_assert_order(order);
 	for (uint8_t i = 0; i < order; ++i)
-		_buffer[_channel_idx][i] = _istream.get_int(sample_bit_size);
+		samples[i] = _istream.get_int(sample_bit_size);
+	tick = _instrumentation.add_stage(decoder_stage::header, tick);
 
-	_decode_residuals(order);
-	_restore_linear_prediction(_fixed_prediction_coefficients[order], order, 0);
+	_decode_residuals(samples, order);
+	tick = _instrumentation.add_stage(decoder_stage::residual, tick);
+	lpc::restore_fixed(samples, _block_size, order);
+	_instrumentation.add_stage(decoder_stage::restore, tick);
 }
 
 
-template<typename INPUT_STREAM, size_t BUFFER_SIZE>
-inline void decoder<INPUT_STREAM, BUFFER_SIZE>::_decode_subframe_lpc(uint8_t order,
-																				uint8_t sample_bit_size)
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+template<typename T>
+inline void decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+						MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::_decode_subframe_lpc(T *samples,
+																uint8_t order, uint8_t sample_bit_size)
 {
+	auto tick = _instrumentation.now();
+	_assert_order(order);
 	for (uint8_t i = 0; i < order; ++i)
-		_buffer[_channel_idx][i] = _istream.get_int(sample_bit_size);
+		samples[i] = _istream.get_int(sample_bit_size);
 
 	auto precision = (uint8_t)_istream.get_uint(4) + 1;
+	if (precision == 16)
+		throw basics::error{"%s: (protocol error) invalid LPC coefficient precision", _decoder_name};
+
 	auto shift =      (int8_t)_istream.get_int(5);
+	if (shift < 0)
+		throw basics::error{"%s: (protocol error) negative LPC shift (%d)", _decoder_name, shift};
+
 	for (int i = 0; i < order; ++i)
 		_coefficients[i] = _istream.get_int(precision);
+	tick = _instrumentation.add_stage(decoder_stage::header, tick);
 
-	_decode_residuals(order);
-	_restore_linear_prediction(_coefficients, order, shift);
+	_decode_residuals(samples, order);
+	tick = _instrumentation.add_stage(decoder_stage::residual, tick);
+	lpc::restore(samples, _block_size, _coefficients, order, shift, sample_bit_size, precision);
+	_instrumentation.add_stage(decoder_stage::restore, tick);
 }
 
 
-template<typename INPUT_STREAM, size_t BUFFER_SIZE>
-inline void decoder<INPUT_STREAM, BUFFER_SIZE>::_decode_residuals(uint8_t order)
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+template<typename T>
+inline void decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+						MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::_decode_residuals(T *samples,
+																						uint8_t order)
 {  // O(N)
 	auto coding_method = (uint8_t)_istream.get_uint(2);
 	if (coding_method > 1)
@@ -448,58 +1741,243 @@ inline void decoder<INPUT_STREAM, BUFFER_SIZE>::_decode_residuals(uint8_t order)
 	auto parameter_bit_size = (uint8_t)(coding_method == 0) ? 4 : 5;
 	auto escape_code = (uint8_t)(coding_method == 0) ? 0xF : 0x1F;
 
-	if (_buffer[_channel_idx].size() % partition_count != 0)
+	if (_block_size % partition_count != 0)
 		throw basics::error{"%s: (protocol error) invalid partition count vs. block size "
-					"(%u %% %u != 0)", _decoder_name, _buffer[_channel_idx].size(), partition_count};
+								"(%u %% %u != 0)", _decoder_name, _block_size, partition_count};
 
-	uint16_t partition_size = _buffer[_channel_idx].size() / partition_count;
+	uint16_t partition_size = _block_size / partition_count;
+	if (partition_size < order)
+		throw basics::error{"%s: (protocol error) predictor order exceeds partition size (%u > %u)",
+															_decoder_name, order, partition_size};
 
+	uint16_t escape_count{0};
 	for (uint16_t i = 0; i < partition_count; ++i) {
 		auto start = (uint16_t)(i * partition_size + ((i == 0) ? order : 0));
 		auto end = (uint16_t)((i + 1) * partition_size);
 
 		auto param = (uint8_t)_istream.get_uint(parameter_bit_size);
 		if (param < escape_code) {
-			for (auto j = start; j < end; ++j)
-				_buffer[_channel_idx][j] = _get_rice_int(param);
+			_istream.get_rice_ints(samples + start, end - start, param);
 		} else {
 			auto bit_count = (uint8_t)_istream.get_uint(5);
 			for (auto j = start; j < end; ++j)
-				_buffer[_channel_idx][j] = _istream.get_int(bit_count);
+				samples[j] = _istream.get_int(bit_count);
+			++escape_count;
+		}
+	}
+	_instrumentation.add_residual(partition_count, escape_count);
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+template<typename T>
+inline void decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+						MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::_restore_wasted_bits(T *samples,
+																			uint8_t wasted_bits) const
+{   // O(N); four samples per step, which compilers turn into vector shifts
+	size_t i = 0;
+	for (; i + 4 <= _block_size; i += 4)
+		for (size_t j = 0; j < 4; ++j)
+			samples[i + j] <<= wasted_bits;
+	for (; i < _block_size; ++i)
+		samples[i] <<= wasted_bits;
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+template<typename T>
+inline void decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+			MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::_restore_stereo(uint8_t channel_assignment,
+																				const T *side)
+{  // O(N), side=left-right; mid=left+right;
+	auto *left = _channel_data(0);
+	auto *right = _channel_data(1);
+	if (channel_assignment == 8) {          // left-side:  ch0=left, ch1=side
+		for (uint16_t i = 0; i < _block_size; ++i)
+			right[i] = left[i] - side[i];
+	} else if (channel_assignment == 9) {   // right-side: ch0=side, ch1=right
+		for (uint16_t i = 0; i < _block_size; ++i)
+			left[i] = side[i] + right[i];
+	} else if (channel_assignment == 10) {  // mid-side:   ch0=mid,  ch1=side
+		for (uint16_t i = 0; i < _block_size; ++i) {
+			const T mid = ((T)left[i] << 1) | (side[i] & 1);  // odd side
+			left[i] = (mid + side[i]) >> 1;
+			right[i] = (mid - side[i]) >> 1;
 		}
 	}
 }
 
 
-template<typename INPUT_STREAM, size_t BUFFER_SIZE>
-inline void decoder<INPUT_STREAM, BUFFER_SIZE>::_restore_linear_prediction(const int16_t *coefficients,
-																		uint8_t order, uint8_t shift)
-{  // O(N*order)
-	for (uint16_t i = order; i < _buffer[_channel_idx].size(); ++i) {
-		int64_t sum{0};
-		for (uint16_t j = 0; j < order; ++j)
-			sum += _buffer[_channel_idx][i - 1 - j] * coefficients[j];
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline void decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+					MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::_assert_order(uint8_t order) const
+{
+	if (order > _block_size)
+		throw basics::error{"%s: (protocol error) predictor order exceeds block size (%u > %u)",
+																_decoder_name, order, _block_size};
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline void decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+					MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::_assert_crc8(size_t frame_position,
+																				uint8_t crc) const
+{   // O(header size)
+	const auto header = _istream.bytes(frame_position, _istream.position() - 1);
+	const auto expected = crc::crc8(header.data(), header.size());
+	if (crc != expected)
+		throw basics::error{"%s: (protocol error) frame header CRC-8 mismatch at byte %zu; got 0x%02x, "
+				"expecting 0x%02x", _decoder_name, frame_position, (unsigned)crc, (unsigned)expected};
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline void decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+					MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::_assert_crc16(size_t frame_position,
+																				uint16_t crc) const
+{   // O(frame size)
+	const auto frame = _istream.bytes(frame_position, _istream.position() - 2);
+	const auto expected = crc::crc16(frame.data(), frame.size());
+	if (crc != expected)
+		throw basics::error{"%s: (protocol error) frame CRC-16 mismatch at byte %zu; got 0x%04x, "
+				"expecting 0x%04x", _decoder_name, frame_position, (unsigned)crc, (unsigned)expected};
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline void decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+						MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::_seek_forward(size_t position,
+																				uint64_t sample)
+{   // O(N); decodes from the frame at position up to the block holding sample
+	_istream.seek(position);
+	_state = state_type::has_metadata;
+	for (;;) {
+		decode_audio();
+		if (_state == state_type::complete)
+			throw basics::error{"%s: (protocol error) sample %lu not found", _decoder_name, sample};
+		if (_block_sample_number + _block_size > sample)
+			break;
+	}
+
+	_block_offset = sample - _block_sample_number;
+	_block_size -= _block_offset;
+	_is_block_pending = true;
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline void decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+		MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::_assert_output_size(std::span<std::byte> out,
+																			pcm::format format) const
+{
+	const auto byte_size = (size_t)_block_size * _streaminfo.channel_count *
+																		pcm::sample_byte_size(format);
+	if (out.size() < byte_size)
+		throw basics::error{"%s: (assertion failed) expecting an output of at least %zu bytes; got %zu",
+																_decoder_name, byte_size, out.size()};
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline void decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+							MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::_assert_streaminfo() const
+{
+	if (_streaminfo.channel_count > MAX_CHANNEL_COUNT)
+		throw basics::error{"%s: (assertion failed) expecting maximum %zu channels; got %u",
+									_decoder_name, MAX_CHANNEL_COUNT, _streaminfo.channel_count};
+	if (_streaminfo.max_block_size > BUFFER_SIZE)
+		throw basics::error{"%s: (assertion failed) expecting maximum %zu samples/block; got %u",
+										_decoder_name, BUFFER_SIZE, _streaminfo.max_block_size};
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline void decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+					MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::_assert_seekable(uint64_t sample)
+{
+	if ((_state != state_type::has_metadata) && (_state != state_type::complete))
+		throw basics::error{"%s: (assertion failed) cannot seek before metadata is decoded",
+																						_decoder_name};
+	if ((_streaminfo.sample_count > 0) && (sample >= _streaminfo.sample_count))
+		throw basics::error{"%s: (assertion failed) cannot seek to sample %lu of %lu",
+												_decoder_name, sample, _streaminfo.sample_count};
+
+	_is_block_pending = false;
+	_md5.reset();  // the digest covers whole streams only
+}
+
 
-		_buffer[_channel_idx][i] += (sum >> shift);
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline size_t decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+					MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::_sync(size_t offset, size_t limit)
+{   // O(N); position of the first frame in [offset, limit) that decodes, limit if none
+	const auto data = _istream.data();
+	for (auto position = find_frame(data, offset, _streaminfo); position < limit;
+											position = find_frame(data, position + 1, _streaminfo)) {
+		_istream.seek(position);
+		try {
+			decode_audio();
+
+			// and is followed by another frame, as a false sync rarely is
+			const auto next_position = _istream.position();
+			if ((next_position == data.size()) ||
+								(_frame_header_size(data, next_position, _streaminfo) > 0))
+				return position;
+		} catch (const basics::error &) {  // false sync
+		}
 	}
+
+	return limit;
 }
 
 
-template<typename INPUT_STREAM, size_t BUFFER_SIZE>
-inline int64_t decoder<INPUT_STREAM, BUFFER_SIZE>::_get_rice_int(size_t bit_count)
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline SAMPLE_TYPE *decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+					MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::_channel_data(uint8_t channel_idx)
 {
-	uint64_t uval{0};
-	while (_istream.get_uint(1) == 0)
-		++uval;
+	return _buffer.data() + channel_idx * _channel_stride;
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline uint64_t decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+			MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::_get_coded_number(uint8_t max_byte_count)
+{   // UTF-8 coded, as extended to 7 bytes and 36 bits
+	const auto lead = (uint8_t)_istream.get_uint(8);
+	const auto byte_count = (lead < 0x80) ? 1 : std::countl_one(lead);
+	if (((byte_count == 1) && (lead >= 0x80)) || (byte_count > max_byte_count))
+		throw basics::error{"%s: (protocol error) unexpected frame number coding (0x%02x)",
+																				_decoder_name, lead};
+
+	uint64_t res = lead & ((byte_count == 1) ? 0x7f : 0x7f >> byte_count);
+	for (int i = 1; i < byte_count; ++i) {
+		const auto byte = (uint8_t)_istream.get_uint(8);
+		if ((byte & 0xc0) != 0x80)
+			throw basics::error{"%s: (protocol error) unexpected frame number coding (0x%02x)",
+																			_decoder_name, byte};
+		res = (res << 6) | (byte & 0x3f);
+	}
 
-	uval = (uval << bit_count) | _istream.get_uint(bit_count);
-	int64_t res = (uval & 1)? -((int64_t)(uval >> 1)) - 1 : (int)(uval >> 1);
 	return res;
 }
 
 
-template<typename INPUT_STREAM, size_t BUFFER_SIZE>
-inline uint16_t decoder<INPUT_STREAM, BUFFER_SIZE>::_get_block_size(uint8_t flags_4bit)
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline uint32_t decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+					MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::_get_block_size(uint8_t flags_4bit)
 {
 	if (flags_4bit == 1)                       return 192;
 	if ((flags_4bit > 1) && (flags_4bit < 6))  return 144 * (1 << flags_4bit);
@@ -511,8 +1989,10 @@ inline uint16_t decoder<INPUT_STREAM, BUFFER_SIZE>::_get_block_size(uint8_t flag
 }
 
 
-template<typename INPUT_STREAM, size_t BUFFER_SIZE>
-inline uint32_t decoder<INPUT_STREAM, BUFFER_SIZE>::_get_sample_rate(uint8_t flags_4bit)
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline uint32_t decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+					MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::_get_sample_rate(uint8_t flags_4bit)
 {
 	if (flags_4bit ==  0) return _streaminfo.sample_rate;
 	if (flags_4bit ==  1) return  88200;
@@ -534,8 +2014,10 @@ inline uint32_t decoder<INPUT_STREAM, BUFFER_SIZE>::_get_sample_rate(uint8_t fla
 }
 
 
-template<typename INPUT_STREAM, size_t BUFFER_SIZE>
-inline uint8_t decoder<INPUT_STREAM, BUFFER_SIZE>::_get_sample_bit_size(uint8_t flags_3bit)
+template<typename INPUT_STREAM, size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT,
+														typename INSTRUMENTATION, typename ALLOCATOR>
+inline uint8_t decoder<INPUT_STREAM, BUFFER_SIZE, SAMPLE_TYPE,
+				MAX_CHANNEL_COUNT, INSTRUMENTATION, ALLOCATOR>::_get_sample_bit_size(uint8_t flags_3bit)
 {
 	if (flags_3bit == 0) return _streaminfo.sample_bit_size;
 	if (flags_3bit == 1) return  8;
@@ -549,6 +2031,1029 @@ inline uint8_t decoder<INPUT_STREAM, BUFFER_SIZE>::_get_sample_bit_size(uint8_t
 }
 
 
+inline size_t _frame_header_size(std::span<const std::byte> data, size_t offset,
+																const streaminfo_type &streaminfo)
+{   // byte size of a valid frame header at offset, 0 otherwise
+	static constexpr uint8_t sample_bit_sizes[8] = {0, 8, 12, 0, 16, 20, 24, 32};
+
+	const auto *header = data.data() + offset;
+	const auto size = data.size() - offset;
+	const auto byte = [header](size_t idx) { return (uint8_t)header[idx]; };
+	if ((size < 6) || (byte(0) != 0xff) || ((byte(1) & 0xfe) != 0xf8))
+		return 0;
+
+	const auto block_size_bitset         = (uint8_t)(byte(2) >> 4);
+	const auto sample_rate_bitset        = (uint8_t)(byte(2) & 0xf);
+	const auto channel_assignment_bitset = (uint8_t)(byte(3) >> 4);
+	const auto sample_bit_size_bitset    = (uint8_t)((byte(3) >> 1) & 0x7);
+	if ((block_size_bitset == 0) || (sample_rate_bitset == 15) || (channel_assignment_bitset > 10) ||
+			(sample_bit_size_bitset == 3) || ((byte(3) & 1) != 0))
+		return 0;
+
+	const auto channel_count = (channel_assignment_bitset < 8) ? channel_assignment_bitset + 1 : 2;
+	if (channel_count != streaminfo.channel_count)
+		return 0;
+	if ((sample_bit_size_bitset != 0) &&
+			(sample_bit_sizes[sample_bit_size_bitset] != streaminfo.sample_bit_size))
+		return 0;
+
+	// UTF-8 coded frame or sample number
+	const auto number_byte_size = (size_t)std::countl_one(byte(4));
+	if ((number_byte_size == 1) || (number_byte_size > 7) || (4 + number_byte_size >= size))
+		return 0;
+	for (size_t i = 1; i < number_byte_size; ++i)
+		if ((byte(4 + i) & 0xc0) != 0x80)
+			return 0;
+
+	const auto size_idx = 4 + std::max<size_t>(number_byte_size, 1);
+	auto res = size_idx;
+	if (block_size_bitset == 6)       res += 1;
+	else if (block_size_bitset == 7)  res += 2;
+	if (sample_rate_bitset == 12)     res += 1;
+	else if (sample_rate_bitset > 12) res += 2;
+	if (res >= size)
+		return 0;
+
+	// decoders reject blocks past the STREAMINFO maximum or past 65535 samples, never coded
+	auto block_size = size_t{0};
+	if (block_size_bitset == 1)       block_size = 192;
+	else if (block_size_bitset < 6)   block_size = 144 << block_size_bitset;
+	else if (block_size_bitset == 6)  block_size = byte(size_idx) + 1;
+	else if (block_size_bitset == 7)  block_size = ((byte(size_idx) << 8) | byte(size_idx + 1)) + 1;
+	else                              block_size = 256 << (block_size_bitset - 8);
+	if ((block_size > 65535) ||
+					((streaminfo.max_block_size > 0) && (block_size > streaminfo.max_block_size)))
+		return 0;
+	if (crc::crc8(header, res) != byte(res))
+		return 0;
+
+	return res + 1;
+}
+
+
+inline size_t find_frame(std::span<const std::byte> data, size_t offset,
+																	const streaminfo_type &streaminfo)
+{   // O(N)
+	while (offset < data.size()) {
+		const auto *next = (const std::byte *)std::memchr(data.data() + offset, 0xff,
+																				data.size() - offset);
+		if (next == nullptr)
+			break;
+
+		offset = next - data.data();
+		if (_frame_header_size(data, offset, streaminfo) > 0)
+			return offset;
+
+		++offset;
+	}
+
+	return data.size();
+}
+
+
+static constexpr const char *_index_name = "audio::flac::frame_index";
+static constexpr std::byte _index_magic[4] =
+								{std::byte{'f'}, std::byte{'L'}, std::byte{'a'}, std::byte{'I'}};
+static constexpr size_t _index_header_size = 12;  // magic, frame count <64>
+static constexpr size_t _index_frame_size = 18;   // byte offset <64>, sample number <64>, count <16>
+
+
+inline void _put_le(std::byte *out, uint64_t value, uint8_t byte_size)
+{
+	for (uint8_t i = 0; i < byte_size; ++i)
+		out[i] = (std::byte)((value >> (8 * i)) & 0xff);
+}
+
+
+inline uint64_t _get_le(const std::byte *data, uint8_t byte_size)
+{
+	uint64_t res{0};
+	for (auto i = byte_size; i-- > 0;)
+		res = (res << 8) | (uint8_t)data[i];
+
+	return res;
+}
+
+
+template<typename DECODER>
+frame_index frame_index::build(DECODER &decoder)
+{   // O(N)
+	if (decoder.state() != decoder_state::has_metadata)
+		throw basics::error{"%s: (assertion failed) expecting a decoder at its first frame",
+																						_index_name};
+
+	auto res = frame_index{};
+	res._storage.resize(_index_header_size);
+	std::copy_n(_index_magic, sizeof(_index_magic), res._storage.data());
+
+	for (;;) {
+		const auto byte_offset = decoder.position();
+		decoder.decode_audio();
+		if (decoder.state() == decoder_state::complete)
+			break;
+
+		res._storage.resize(res._storage.size() + _index_frame_size);
+		auto *frame = res._storage.data() + res._storage.size() - _index_frame_size;
+		_put_le(frame, byte_offset, 8);
+		_put_le(frame + 8, decoder.block_sample_number(), 8);
+		_put_le(frame + 16, decoder.block_size(), 2);
+		++res._size;
+	}
+
+	_put_le(res._storage.data() + sizeof(_index_magic), res._size, 8);
+	res._blob = res._storage;
+
+	return res;
+}
+
+
+inline std::span<const std::byte> frame_index::serialize() const
+{
+	return _blob;
+}
+
+
+inline size_t frame_index::size() const
+{
+	return _size;
+}
+
+
+inline frame_type frame_index::operator[](size_t frame_idx) const
+{
+	const auto *frame = _blob.data() + _index_header_size + frame_idx * _index_frame_size;
+
+	return {_get_le(frame, 8), _get_le(frame + 8, 8), (uint16_t)_get_le(frame + 16, 2)};
+}
+
+
+inline size_t frame_index::find(uint64_t sample) const
+{   // O(log N)
+	size_t low{0}, high{_size};  // the frame starts within [low, high)
+	while (high - low > 1) {
+		const auto middle = low + (high - low) / 2;
+		if ((*this)[middle].sample_number <= sample)
+			low = middle;
+		else
+			high = middle;
+	}
+
+	if (_size == 0)
+		return _size;
+
+	const auto frame = (*this)[low];
+	if ((frame.sample_number > sample) || (frame.sample_number + frame.sample_count <= sample))
+		return _size;
+
+	return low;
+}
+
+
+inline size_t frame_index::find_offset(size_t byte_offset) const
+{   // O(log N)
+	size_t low{0}, high{_size};
+	while (low < high) {
+		const auto middle = low + (high - low) / 2;
+		if ((*this)[middle].byte_offset < byte_offset)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	return low;
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+parallel_decoder<BUFFER_SIZE, SAMPLE_TYPE,
+								MAX_CHANNEL_COUNT>::parallel_decoder(std::span<const std::byte> data,
+														size_t thread_count, size_t chunk_byte_size)
+	: _data{data}, _istream{data}, _decoder{_istream}, _pool{thread_count}, _index{nullptr},
+	  _chunk_byte_size{std::max<size_t>(chunk_byte_size, 1)}, _schedule_offset{0}, _chunks{}, _chunk{},
+	  _block_idx{0}, _position{0}, _state{state_type::init}, _block_size{0}, _block_sample_rate{0},
+	  _block_sample_number{0}, _block_data{nullptr}, _is_verifying{false}, _md5{}
+{
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+parallel_decoder<BUFFER_SIZE, SAMPLE_TYPE,
+								MAX_CHANNEL_COUNT>::parallel_decoder(std::span<const std::byte> data,
+								const frame_index &index, size_t thread_count, size_t chunk_byte_size)
+	: parallel_decoder{data, thread_count, chunk_byte_size}
+{
+	_index = &index;
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+void parallel_decoder<BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>::decode_marker()
+{
+	_decoder.decode_marker();
+	_state = _decoder.state();
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+void parallel_decoder<BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>::decode_metadata()
+{
+	_decoder.decode_metadata();
+	_state = _decoder.state();
+	if (_state != state_type::has_metadata)
+		return;
+
+	_position = _decoder.position();
+	_schedule_offset = _position;
+	_schedule();
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+void parallel_decoder<BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>::decode_audio()
+{   // O(N)
+	while (_block_idx == _chunk.blocks.size()) {
+		if (_chunks.empty()) {
+			_state = state_type::complete;
+			if (_md5) {
+				const auto digest = _md5->digest();
+				_md5.reset();
+				_assert_md5_signature(digest, _decoder.streaminfo());
+			}
+
+			return;
+		}
+
+		auto chunk = _chunks.front().get();
+		_chunks.pop_front();
+		if (!chunk.is_valid || (chunk.begin != _position))  // synced on a false frame header
+			chunk = _decode_chunk(_position, chunk.limit, true, _is_verifying);
+
+		_position = chunk.end;
+		_chunk = std::move(chunk);
+		_block_idx = 0;
+		_schedule();
+	}
+
+	const auto &block = _chunk.blocks[_block_idx++];
+	_block_size = block.size;
+	_block_sample_rate = block.sample_rate;
+	_block_sample_number = block.sample_number;
+	_block_data = _chunk.samples.data() + block.sample_offset;
+	if (!_md5)
+		return;
+
+	const auto format = _md5_format(streaminfo().sample_bit_size);
+	const auto byte_size = (size_t)_block_size * streaminfo().channel_count *
+																		pcm::sample_byte_size(format);
+	auto out = _md5->buffer(byte_size);
+	pcm::pack(out.data(), block_data(), _block_size, format);
+	_md5->submit();
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+void parallel_decoder<BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>::set_verification(bool is_enabled)
+{
+	_is_verifying = is_enabled;
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+void parallel_decoder<BUFFER_SIZE, SAMPLE_TYPE,
+											MAX_CHANNEL_COUNT>::set_md5_verification(bool is_enabled)
+{
+	if (!is_enabled) {
+		_md5.reset();
+
+		return;
+	}
+
+	// the metadata decoder stays at the first frame
+	if ((_state != state_type::has_metadata) || (_position != _decoder.position()))
+		throw basics::error{"%s: (assertion failed) MD5 verification must start at the first frame",
+																						_decoder_name};
+
+	_md5 = std::make_unique<md5::pipeline>();
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+inline const decoder_state &parallel_decoder<BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>::state() const
+{
+	return _state;
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+inline const streaminfo_type &parallel_decoder<BUFFER_SIZE, SAMPLE_TYPE,
+																MAX_CHANNEL_COUNT>::streaminfo() const
+{
+	return _decoder.streaminfo();
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+inline const uint32_t &parallel_decoder<BUFFER_SIZE, SAMPLE_TYPE,
+														MAX_CHANNEL_COUNT>::block_sample_rate() const
+{
+	return _block_sample_rate;
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+inline const uint64_t &parallel_decoder<BUFFER_SIZE, SAMPLE_TYPE,
+														MAX_CHANNEL_COUNT>::block_sample_number() const
+{
+	return _block_sample_number;
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+inline audio_data<SAMPLE_TYPE> parallel_decoder<BUFFER_SIZE, SAMPLE_TYPE,
+																MAX_CHANNEL_COUNT>::block_data() const
+{
+	return {_block_data, _block_size, _decoder.streaminfo().channel_count, _block_size};
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+inline const uint16_t &parallel_decoder<BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>::block_size() const
+{
+	return _block_size;
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+inline bool parallel_decoder<BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>::verification() const
+{
+	return _is_verifying;
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+typename parallel_decoder<BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>::_chunk_type
+parallel_decoder<BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>::_decode_chunk(size_t offset,
+											size_t limit, bool is_synced, bool is_verifying) const
+{   // O(N); runs on the pool, reading only immutable members
+	auto res = _chunk_type{offset, offset, limit, true, {}, {}};
+	try {
+		if (!is_synced)
+			res.begin = res.end = find_frame(_data, offset, _decoder.streaminfo());
+		if (res.begin >= limit)  // no frame starts within the chunk
+			return res;
+
+		// the worker's decoder keeps its buffers from chunk to chunk
+		thread_local auto worker = _worker_type{};
+		worker.istream = memory::input{_data.subspan(res.begin)};
+		auto &frame_decoder = worker.decoder;
+		frame_decoder.reset(worker.istream, _decoder.streaminfo());
+		frame_decoder.set_verification(is_verifying);
+
+		// sized once for the chunk's bytes at 2:1 compression; denser chunks grow it
+		const auto &streaminfo = _decoder.streaminfo();
+		const auto byte_size = std::min(limit, _data.size()) - res.begin;
+		res.samples.reserve(byte_size * 16 / streaminfo.sample_bit_size +
+										(size_t)streaminfo.max_block_size * streaminfo.channel_count);
+		while (res.begin + frame_decoder.position() < limit) {
+			frame_decoder.decode_audio();
+			if (frame_decoder.state() == state_type::complete)
+				break;
+
+			const auto block = frame_decoder.block_data();
+			res.blocks.push_back({res.samples.size(), frame_decoder.block_size(),
+							frame_decoder.block_sample_rate(), frame_decoder.block_sample_number()});
+			for (uint8_t channel_idx = 0; channel_idx < block.channel_count(); ++channel_idx)
+				res.samples.insert(res.samples.end(), block[channel_idx].begin(),
+																			block[channel_idx].end());
+		}
+		res.end = res.begin + frame_decoder.position();
+	} catch (const basics::error &) {
+		if (is_synced)
+			throw;
+
+		res.is_valid = false;
+	}
+
+	return res;
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+void parallel_decoder<BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>::_schedule()
+{
+	// keeps two chunks per worker in flight, bounding the decoded-ahead memory
+	while ((_chunks.size() < 2 * _pool.thread_count()) && (_schedule_offset < _data.size())) {
+		const auto offset = _schedule_offset;
+		const auto is_synced = (offset == _position) || (_index != nullptr);  // a known frame boundary
+		_schedule_offset += _chunk_byte_size;
+		if (_index != nullptr) {
+			const auto frame_idx = _index->find_offset(_schedule_offset);
+			_schedule_offset = (frame_idx < _index->size()) ?
+														(*_index)[frame_idx].byte_offset : _data.size();
+		}
+		_chunks.push_back(_pool.submit([this, offset, limit = _schedule_offset, is_synced,
+															is_verifying = _is_verifying]() {
+			return _decode_chunk(offset, limit, is_synced, is_verifying);
+		}));
+	}
+}
+
+
+static constexpr const char *_stream_decoder_name = "audio::flac::stream_decoder";
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+stream_decoder<BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>::stream_decoder()
+	: _data{}, _offset{0}, _is_fed{false}, _is_finished{false}, _state{state_type::init}, _streaminfo{},
+	  _skipped_byte_count{0}, _istream{{}}, _decoder{_istream}
+{
+	_decoder.set_verification(true);  // telling corrupt frames apart
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+stream_decoder<BUFFER_SIZE, SAMPLE_TYPE,
+								MAX_CHANNEL_COUNT>::stream_decoder(const streaminfo_type &streaminfo)
+	: stream_decoder{}
+{
+	_decoder.reset(_istream, streaminfo);  // asserts it
+	_streaminfo = streaminfo;
+	_state = state_type::has_metadata;
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+void stream_decoder<BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>::feed(std::span<const std::byte> data)
+{   // O(N); moves the bytes not decoded yet, less than a frame, to the front
+	if (_is_finished)
+		throw basics::error{"%s: (assertion failed) feeding a finished stream", _stream_decoder_name};
+
+	_data.erase(_data.begin(), _data.begin() + _offset);
+	_offset = 0;
+	_data.insert(_data.end(), data.begin(), data.end());
+	_is_fed = true;
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+void stream_decoder<BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>::finish()
+{
+	_is_finished = true;
+	_is_fed = true;
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+feed_status stream_decoder<BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>::try_decode()
+{   // O(N)
+	if (_state == state_type::complete)
+		return feed_status::complete;
+	if (!_is_fed)  // nothing new to decode
+		return feed_status::need_data;
+
+	return (_state == state_type::init) ? _decode_metadata() : _decode_frame();
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+inline const decoder_state &stream_decoder<BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>::state() const
+{
+	return _state;
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+inline const streaminfo_type &stream_decoder<BUFFER_SIZE, SAMPLE_TYPE,
+																MAX_CHANNEL_COUNT>::streaminfo() const
+{
+	return _streaminfo;
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+inline const uint32_t &stream_decoder<BUFFER_SIZE, SAMPLE_TYPE,
+														MAX_CHANNEL_COUNT>::block_sample_rate() const
+{
+	return _decoder.block_sample_rate();
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+inline uint64_t stream_decoder<BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>::block_sample_number() const
+{
+	return _decoder.block_sample_number();
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+inline audio_data<SAMPLE_TYPE> stream_decoder<BUFFER_SIZE, SAMPLE_TYPE,
+																MAX_CHANNEL_COUNT>::block_data() const
+{
+	return _decoder.block_data();
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+inline const uint16_t &stream_decoder<BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>::block_size() const
+{
+	return _decoder.block_size();
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+inline size_t stream_decoder<BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>::buffered_byte_size() const
+{
+	return _data.size() - _offset;
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+inline const uint64_t &stream_decoder<BUFFER_SIZE, SAMPLE_TYPE,
+														MAX_CHANNEL_COUNT>::skipped_byte_count() const
+{
+	return _skipped_byte_count;
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+feed_status stream_decoder<BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>::_decode_metadata()
+{   // O(metadata block count)
+	static constexpr std::byte marker[4] =
+								{std::byte{'f'}, std::byte{'L'}, std::byte{'a'}, std::byte{'C'}};
+
+	if (!_data.empty() && (std::memcmp(_data.data(), marker,
+														std::min(_data.size(), sizeof(marker))) != 0))
+		throw basics::error{"%s: (protocol error) unexpected marker", _stream_decoder_name};
+
+	// the metadata is whole once the last block is
+	const auto res = (_data.size() < 4 + 4 + 34) ? probe_type{} : probe(_data);
+	if ((res.audio_offset == 0) || (res.audio_offset > _data.size())) {
+		if (_is_finished)
+			throw basics::error{"%s: (protocol error) unexpected end of stream", _stream_decoder_name};
+
+		return _need_data();
+	}
+
+	_decoder.reset(_istream, res.streaminfo);
+	_streaminfo = res.streaminfo;
+	_offset = res.audio_offset;
+	_state = state_type::has_metadata;
+
+	return feed_status::has_metadata;
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+feed_status stream_decoder<BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>::_decode_frame()
+{   // O(N)
+	const auto data = std::span<const std::byte>{_data};
+	while (true) {
+		const auto position = find_frame(data, _offset, _streaminfo);
+		if (position == data.size()) {  // no frame header yet
+			if (_is_finished) {
+				_skipped_byte_count += data.size() - _offset;
+				_offset = data.size();
+				_state = state_type::complete;
+
+				return feed_status::complete;
+			}
+
+			// keeps a header that may be partly fed
+			const auto kept_byte_size = std::min(data.size() - _offset, _max_header_size - 1);
+			_skipped_byte_count += data.size() - _offset - kept_byte_size;
+			_offset = data.size() - kept_byte_size;
+
+			return _need_data();
+		}
+
+		_skipped_byte_count += position - _offset;
+		_offset = position;
+		const auto byte_size = data.size() - _offset;
+		if (!_is_finished && (byte_size < _streaminfo.min_frame_size))
+			return _need_data();
+
+		_istream = memory::input{data.subspan(_offset)};
+		_decoder.reset(_istream, _streaminfo);
+		try {
+			_decoder.decode_audio();
+			_offset += _decoder.position();
+
+			return feed_status::has_block;
+		} catch (const basics::error &) {
+			// a frame running past the bytes fed so far is only truncated
+			if (!_is_finished && (byte_size < _max_frame_size()) &&
+					((_decoder.position() + 8 >= byte_size) ||
+									(find_frame(data, _offset + 1, _streaminfo) == data.size())))
+				return _need_data();
+		}
+
+		// corrupt or false frame header
+		++_skipped_byte_count;
+		++_offset;
+	}
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+feed_status stream_decoder<BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>::_need_data()
+{
+	_is_fed = false;
+
+	return feed_status::need_data;
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+inline size_t stream_decoder<BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>::_max_frame_size() const
+{   // from the STREAMINFO, or that of a frame of VERBATIM subframes with all bits wasted
+	if (_streaminfo.max_frame_size > 0)
+		return _streaminfo.max_frame_size;
+
+	const auto block_size = (_streaminfo.max_block_size > 0) ? _streaminfo.max_block_size : BUFFER_SIZE;
+	const auto subframe_size = 1 + (_streaminfo.sample_bit_size + 7) / 8 +
+											(block_size * (_streaminfo.sample_bit_size + 1) + 7) / 8;
+
+	return _max_header_size + _streaminfo.channel_count * subframe_size + 2;
+}
+
+
+static constexpr const char *_batch_decoder_name = "audio::flac::batch_decoder";
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+batch_decoder<BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>::_worker_type::_worker_type()
+	: mutex{}, streams{}, istream{{}}, decoder{istream}
+{
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+batch_decoder<BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>::batch_decoder(size_t thread_count,
+																			size_t slice_frame_count)
+	: _slice_frame_count{slice_frame_count}, _is_verifying{false}, _workers{}, _streams{},
+	  _on_block{nullptr}, _on_error{nullptr}, _pending_count{0}, _push_count{0}, _is_stopping{false},
+	  _exception_mutex{}, _exception{}
+{
+	if (thread_count == 0)
+		thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+	if (slice_frame_count == 0)
+		throw basics::error{"%s: (assertion failed) expecting at least one frame per slice",
+																				_batch_decoder_name};
+
+	_workers.reserve(thread_count);
+	for (size_t i = 0; i < thread_count; ++i)
+		_workers.push_back(std::make_unique<_worker_type>());
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+void batch_decoder<BUFFER_SIZE, SAMPLE_TYPE,
+						MAX_CHANNEL_COUNT>::decode(std::span<const std::span<const std::byte>> streams,
+								const block_handler_type &on_block, const error_handler_type &on_error)
+{   // O(N) over the threads
+	_streams.clear();
+	for (const auto &data: streams)
+		_streams.push_back({data, 0, {}});
+	_on_block = &on_block;
+	_on_error = &on_error;
+	_pending_count = _streams.size();
+	_is_stopping = false;
+	_exception = nullptr;
+
+	for (size_t stream_idx = 0; stream_idx < _streams.size(); ++stream_idx)  // dealt out in turn
+		_workers[stream_idx % _workers.size()]->streams.push_back(stream_idx);
+
+	auto threads = std::vector<std::thread>{};
+	threads.reserve(_workers.size() - 1);
+	for (size_t worker_idx = 1; worker_idx < _workers.size(); ++worker_idx)
+		threads.emplace_back(&batch_decoder::_work, this, worker_idx);
+	_work(0);
+	for (auto &thread: threads)
+		thread.join();
+
+	for (auto &worker: _workers)  // streams left over by a stop
+		worker->streams.clear();
+	_streams.clear();
+	if (_exception)
+		std::rethrow_exception(_exception);
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+void batch_decoder<BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>::set_verification(bool is_enabled)
+{
+	_is_verifying = is_enabled;
+	for (auto &worker: _workers)
+		worker->decoder.set_verification(is_enabled);
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+inline size_t batch_decoder<BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>::thread_count() const
+{
+	return _workers.size();
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+inline bool batch_decoder<BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>::verification() const
+{
+	return _is_verifying;
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+void batch_decoder<BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>::_work(size_t worker_idx)
+{
+	auto &worker = *_workers[worker_idx];
+	while (!_is_stopping) {
+		const auto push_count = _push_count.load();
+		size_t stream_idx;
+		if (!_take(worker_idx, stream_idx)) {
+			if (_pending_count == 0)
+				return;
+
+			_push_count.wait(push_count);  // until a stream is queued again, or the last one is done
+			continue;
+		}
+
+		auto is_pending = false;
+		try {
+			is_pending = _decode_slice(worker, stream_idx);
+		} catch (...) {  // thrown by a callback
+			_stop(std::current_exception());
+
+			return;
+		}
+
+		if (is_pending) {  // for this worker to go on with, unless stolen
+			std::lock_guard lock{worker.mutex};
+			worker.streams.push_back(stream_idx);
+		} else if (--_pending_count > 0) {
+			continue;
+		}
+
+		// wakes the idle workers, to steal the stream or to return after the last one
+		++_push_count;
+		_push_count.notify_all();
+	}
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+bool batch_decoder<BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>::_take(size_t worker_idx,
+																					size_t &stream_idx)
+{   // O(thread count); the latest stream of the worker, else the oldest of another one
+	{
+		auto &worker = *_workers[worker_idx];
+		std::lock_guard lock{worker.mutex};
+		if (!worker.streams.empty()) {
+			stream_idx = worker.streams.back();
+			worker.streams.pop_back();
+
+			return true;
+		}
+	}
+
+	for (size_t i = 1; i < _workers.size(); ++i) {
+		auto &victim = *_workers[(worker_idx + i) % _workers.size()];
+		std::lock_guard lock{victim.mutex};
+		if (!victim.streams.empty()) {
+			stream_idx = victim.streams.front();
+			victim.streams.pop_front();
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+bool batch_decoder<BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>::_decode_slice(_worker_type &worker,
+																					size_t stream_idx)
+{   // O(slice); only the worker holding the stream touches it
+	auto &stream = _streams[stream_idx];
+	auto &decoder = worker.decoder;
+	try {
+		if (stream.position == 0) {
+			worker.istream = memory::input{stream.data};
+			decoder.reset(worker.istream);
+			decoder.decode_marker();
+			while (decoder.state() != decoder_state::has_metadata)
+				decoder.decode_metadata();
+			stream.streaminfo = decoder.streaminfo();
+			stream.position = decoder.position();
+		}
+
+		worker.istream = memory::input{stream.data.subspan(stream.position)};
+		decoder.reset(worker.istream, stream.streaminfo);
+	} catch (const basics::error &err) {
+		(*_on_error)(stream_idx, err);
+
+		return false;
+	}
+
+	for (size_t frame_idx = 0; frame_idx < _slice_frame_count; ++frame_idx) {
+		try {
+			decoder.decode_audio();
+		} catch (const basics::error &err) {
+			(*_on_error)(stream_idx, err);
+
+			return false;
+		}
+		if (decoder.state() == decoder_state::complete)
+			return false;
+
+		(*_on_block)(stream_idx, decoder);
+	}
+
+	stream.position += decoder.position();
+
+	return stream.position < stream.data.size();
+}
+
+
+template<size_t BUFFER_SIZE, typename SAMPLE_TYPE, size_t MAX_CHANNEL_COUNT>
+void batch_decoder<BUFFER_SIZE, SAMPLE_TYPE, MAX_CHANNEL_COUNT>::_stop(std::exception_ptr exception)
+{
+	{
+		std::lock_guard lock{_exception_mutex};
+		if (!_exception)
+			_exception = exception;
+	}
+	_is_stopping = true;
+	++_push_count;
+	_push_count.notify_all();
+}
+
+
+static constexpr const char *_encoder_name = "audio::flac::encoder";
+
+
+template<typename OUTPUT_STREAM>
+encoder<OUTPUT_STREAM>::encoder(OUTPUT_STREAM &ostream, const streaminfo_type &streaminfo,
+															size_t thread_count, uint8_t max_lpc_order)
+	: _ostream{ostream}, _streaminfo{streaminfo},
+	  _max_lpc_order{std::min(max_lpc_order, lpc::max_order)}, _pool{thread_count}, _frames{}, _block{},
+	  _block_size{0}, _frame_count{0}, _sample_count{0}
+{
+	if (_streaminfo.max_block_size == 0)
+		_streaminfo.max_block_size = default_block_size;
+	_streaminfo.min_block_size = _streaminfo.max_block_size;
+	_streaminfo.min_frame_size = 0;
+	_streaminfo.max_frame_size = 0;
+	_streaminfo.md5_signature = {};
+	_assert_streaminfo();
+
+	_block.resize((size_t)_streaminfo.max_block_size * _streaminfo.channel_count);
+}
+
+
+template<typename OUTPUT_STREAM>
+void encoder<OUTPUT_STREAM>::encode_marker()
+{
+	static constexpr std::byte marker[] =
+								{std::byte{'f'}, std::byte{'L'}, std::byte{'a'}, std::byte{'C'}};
+	_write(marker, sizeof(marker));
+}
+
+
+template<typename OUTPUT_STREAM>
+void encoder<OUTPUT_STREAM>::encode_metadata()
+{
+	auto ostream = bit::output{};
+
+	// METADATA_BLOCK_HEADER <32>: last, STREAMINFO, 34 bytes
+	ostream.put_uint(1, 1);
+	ostream.put_uint(0, 7);
+	ostream.put_uint(34, 24);
+
+	// METADATA_BLOCK_STREAMINFO
+	ostream.put_uint(_streaminfo.min_block_size, 16);
+	ostream.put_uint(_streaminfo.max_block_size, 16);
+	ostream.put_uint(0, 24);  // min frame size, unknown
+	ostream.put_uint(0, 24);  // max frame size, unknown
+	ostream.put_uint(_streaminfo.sample_rate, 20);
+	ostream.put_uint(_streaminfo.channel_count - 1, 3);
+	ostream.put_uint(_streaminfo.sample_bit_size - 1, 5);
+	ostream.put_uint(_streaminfo.sample_count, 36);
+	for (uint8_t i = 0; i < 16; ++i)
+		ostream.put_uint(0, 8);  // MD5 signature, unset
+	ostream.align();
+
+	_write(ostream.data().data(), ostream.data().size());
+}
+
+
+template<typename OUTPUT_STREAM>
+template<typename T>
+void encoder<OUTPUT_STREAM>::encode_audio(const sample_view<T> &planar, size_t count)
+{   // O(N); encoding itself runs on the pool
+	if (planar.channel_count() != _streaminfo.channel_count)
+		throw basics::error{"%s: (assertion failed) expecting %u channels; got %u",
+									_encoder_name, _streaminfo.channel_count, planar.channel_count()};
+
+	for (size_t offset = 0; offset < count;) {
+		const auto sample_count = std::min<size_t>(count - offset,
+															_streaminfo.max_block_size - _block_size);
+		for (uint8_t channel_idx = 0; channel_idx < _streaminfo.channel_count; ++channel_idx) {
+			const auto channel = planar[channel_idx];
+			std::copy_n(channel.begin() + offset, sample_count,
+						_block.begin() + channel_idx * _streaminfo.max_block_size + _block_size);
+		}
+		offset += sample_count;
+		_block_size += sample_count;
+		if (_block_size == _streaminfo.max_block_size)
+			_submit();
+	}
+}
+
+
+template<typename OUTPUT_STREAM>
+void encoder<OUTPUT_STREAM>::finish()
+{   // O(N)
+	if (_block_size > 0)
+		_submit();
+	while (!_frames.empty())
+		_write_frame();
+	_streaminfo.sample_count = _sample_count;
+	_ostream.flush();
+}
+
+
+template<typename OUTPUT_STREAM>
+inline const streaminfo_type &encoder<OUTPUT_STREAM>::streaminfo() const
+{
+	return _streaminfo;
+}
+
+
+template<typename OUTPUT_STREAM>
+void encoder<OUTPUT_STREAM>::_submit()
+{
+	// keeps two frames per worker in flight, bounding the buffered samples
+	if (_frames.size() >= 2 * _pool.thread_count())
+		_write_frame();
+
+	_frames.push_back(_pool.submit([block = _block, block_size = _block_size, streaminfo = _streaminfo,
+									frame_number = _frame_count, max_lpc_order = _max_lpc_order]() {
+		const auto planar = sample_view<const int32_t>{block.data(), streaminfo.max_block_size,
+																streaminfo.channel_count, block_size};
+
+		return encode_frame(planar, streaminfo, frame_number, max_lpc_order);
+	}));
+	_sample_count += _block_size;
+	_block_size = 0;
+	++_frame_count;
+}
+
+
+template<typename OUTPUT_STREAM>
+void encoder<OUTPUT_STREAM>::_write_frame()
+{
+	const auto frame = _frames.front().get();
+	_frames.pop_front();
+	_write(frame.data(), frame.size());
+
+	const auto frame_size = (uint32_t)frame.size();
+	_streaminfo.min_frame_size = (_streaminfo.min_frame_size == 0) ?
+										frame_size : std::min(_streaminfo.min_frame_size, frame_size);
+	_streaminfo.max_frame_size = std::max(_streaminfo.max_frame_size, frame_size);
+}
+
+
+template<typename OUTPUT_STREAM>
+void encoder<OUTPUT_STREAM>::_write(const std::byte *data, size_t size)
+{
+	if constexpr (requires { _ostream.write((const char *)data, size); }) {
+		_ostream.write((const char *)data, size);
+	} else {
+		for (size_t i = 0; i < size; ++i)
+			_ostream.put((char)data[i]);
+	}
+}
+
+
+template<typename OUTPUT_STREAM>
+inline void encoder<OUTPUT_STREAM>::_assert_streaminfo() const
+{
+	if ((_streaminfo.channel_count == 0) || (_streaminfo.channel_count > max_channel_count))
+		throw basics::error{"%s: (assertion failed) unsupported channel count (%u)",
+															_encoder_name, _streaminfo.channel_count};
+	if ((_streaminfo.sample_bit_size < 4) || (_streaminfo.sample_bit_size > 32))
+		throw basics::error{"%s: (assertion failed) unsupported sample bit size (%u)",
+															_encoder_name, _streaminfo.sample_bit_size};
+	if ((_streaminfo.sample_rate == 0) || (_streaminfo.sample_rate >= (1u << 20)))
+		throw basics::error{"%s: (assertion failed) unsupported sample rate (%u)",
+																_encoder_name, _streaminfo.sample_rate};
+	if (_streaminfo.max_block_size < 16)
+		throw basics::error{"%s: (assertion failed) block size below 16 (%u)",
+															_encoder_name, _streaminfo.max_block_size};
+}
+
+
 } // namespace flac
 } // namespace audio
 
@@ -0,0 +1,186 @@
+/* Copyright (C) 2024  Bogdan-Gabriel Alecu  (GameInstance.com)
+ *
+ * audio - C++ audio codecs.
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIO_LPC
+#define AUDIO_LPC
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+
+/*******************************************************************************************************
+ *
+ * @name  Linear prediction
+ *
+ * @brief Linear prediction restoration kernels and analysis.
+ *
+ * The audio::lpc::restore_fixed() and audio::lpc::restore() function templates turn a block holding
+ * order warm-up samples followed by residuals into the predicted signal, in place. FIXED orders 0-4
+ * and the common LPC orders 8, 12 and 32 are specialized at compile time; other orders use a generic
+ * loop. Samples of at most 32 bits are restored by an AVX2 or NEON kernel when the CPU supports it.
+ * Otherwise an int32_t accumulator is used when sample_bit_size + precision + log2(order) fits in 32
+ * bits, and an int64_t one when it doesn't.
+ *
+ * The analysis functions serve encoders. tukey_window() computes a Tukey window of parameter 0.5 and
+ * autocorrelation() the autocorrelation of a windowed signal. levinson_durbin() solves for the
+ * predictor of every order up to order, returning their prediction errors as well, and
+ * quantize() turns one of them into integer coefficients of a given precision and a shift.
+ * residual_fixed() and residual() are the inverses of restore_fixed() and restore(): they compute
+ * the residuals past the order warm-up samples with 64-bit accumulation, as restore() does.
+ *
+ */
+
+
+namespace audio {
+namespace lpc {
+
+
+static const uint8_t max_fixed_order = 4;
+static const uint8_t max_order = 32;
+
+template<typename T>
+using vector_kernel_type = void (*)(T *samples, size_t size, const int32_t *coefficients, uint8_t order,
+																						uint8_t shift);
+
+template<typename T>
+inline void restore_fixed(T *samples, size_t size, uint8_t order);
+template<typename T>
+inline void restore(T *samples, size_t size, const int32_t *coefficients, uint8_t order, uint8_t shift,
+															uint8_t sample_bit_size, uint8_t precision);
+
+// restore samples of at most 32 bits with 64-bit accumulation, or nullptr without a vector unit
+extern const vector_kernel_type<int32_t> vector_kernel_32;
+extern const vector_kernel_type<int64_t> vector_kernel_64;
+
+void tukey_window(double *window, size_t size);
+void autocorrelation(const int64_t *samples, const double *window, size_t size, uint8_t lag_count,
+																					double *res);
+uint8_t levinson_durbin(const double *autocorrelation, uint8_t order, double coefficients[][max_order],
+																					double *errors);
+int8_t quantize(const double *coefficients, uint8_t order, uint8_t precision, int32_t *res);
+void residual_fixed(const int64_t *samples, size_t size, uint8_t order, int64_t *res);
+void residual(const int64_t *samples, size_t size, const int32_t *coefficients, uint8_t order,
+																		uint8_t shift, int64_t *res);
+
+
+/******************************************************************************************************/
+
+
+static constexpr int32_t _fixed_coefficients[max_fixed_order + 1][max_fixed_order] = {
+	{},
+	{1},
+	{2, -1},
+	{3, -3, 1},
+	{4, -6, 4, -1},
+};
+
+
+template<typename T, typename ACCUMULATOR, uint8_t ORDER>
+inline void _restore_fixed(T *samples, size_t size)
+{   // O(N)
+	for (size_t i = ORDER; i < size; ++i) {
+		ACCUMULATOR sum{0};
+		for (uint8_t j = 0; j < ORDER; ++j)
+			sum += (ACCUMULATOR)_fixed_coefficients[ORDER][j] * samples[i - 1 - j];
+
+		samples[i] += (T)sum;
+	}
+}
+
+
+template<typename T, typename ACCUMULATOR, uint8_t ORDER>
+inline void _restore(T *samples, size_t size, const int32_t *coefficients, uint8_t shift)
+{   // O(N*ORDER), with the tap loop unrolled
+	int32_t taps[ORDER];
+	for (uint8_t j = 0; j < ORDER; ++j)
+		taps[j] = coefficients[j];
+
+	for (size_t i = ORDER; i < size; ++i) {
+		ACCUMULATOR sum{0};
+		for (uint8_t j = 0; j < ORDER; ++j)
+			sum += (ACCUMULATOR)taps[j] * (ACCUMULATOR)samples[i - 1 - j];
+
+		samples[i] += (T)(sum >> shift);
+	}
+}
+
+
+template<typename T, typename ACCUMULATOR>
+inline void _restore(T *samples, size_t size, const int32_t *coefficients, uint8_t order, uint8_t shift)
+{   // O(N*order)
+	switch (order) {
+		case 8:
+			return _restore<T, ACCUMULATOR, 8>(samples, size, coefficients, shift);
+		case 12:
+			return _restore<T, ACCUMULATOR, 12>(samples, size, coefficients, shift);
+		case 32:
+			return _restore<T, ACCUMULATOR, 32>(samples, size, coefficients, shift);
+	}
+
+	for (size_t i = order; i < size; ++i) {
+		ACCUMULATOR sum{0};
+		for (uint8_t j = 0; j < order; ++j)
+			sum += (ACCUMULATOR)coefficients[j] * (ACCUMULATOR)samples[i - 1 - j];
+
+		samples[i] += (T)(sum >> shift);
+	}
+}
+
+
+template<typename T>
+inline void restore_fixed(T *samples, size_t size, uint8_t order)
+{
+	switch (order) {
+		case 1:
+			return _restore_fixed<T, int64_t, 1>(samples, size);
+		case 2:
+			return _restore_fixed<T, int64_t, 2>(samples, size);
+		case 3:
+			return _restore_fixed<T, int64_t, 3>(samples, size);
+		case 4:
+			return _restore_fixed<T, int64_t, 4>(samples, size);
+	}
+	// order 0: residuals are the samples
+}
+
+
+template<typename T>
+inline void restore(T *samples, size_t size, const int32_t *coefficients, uint8_t order, uint8_t shift,
+															uint8_t sample_bit_size, uint8_t precision)
+{
+	if constexpr (std::is_same_v<T, int32_t>) {
+		if (vector_kernel_32 != nullptr)
+			return vector_kernel_32(samples, size, coefficients, order, shift);
+	} else if constexpr (std::is_same_v<T, int64_t>) {
+		if ((vector_kernel_64 != nullptr) && (sample_bit_size <= 32))
+			return vector_kernel_64(samples, size, coefficients, order, shift);
+	}
+
+	const auto sum_bit_size = sample_bit_size + precision + std::bit_width(order - 1u);
+	if (sum_bit_size <= 32)
+		return _restore<T, int32_t>(samples, size, coefficients, order, shift);
+
+	_restore<T, int64_t>(samples, size, coefficients, order, shift);
+}
+
+
+} // namespace lpc
+} // namespace audio
+
+
+#endif // AUDIO_LPC
@@ -0,0 +1,93 @@
+/* Copyright (C) 2024  Bogdan-Gabriel Alecu  (GameInstance.com)
+ *
+ * audio - C++ audio codecs.
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIO_MD5
+#define AUDIO_MD5
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <span>
+#include <vector>
+#include "pool.hh"
+
+
+/*******************************************************************************************************
+ *
+ * @name  MD5
+ *
+ * @brief Incremental MD5 message digests.
+ *
+ * The audio::md5::context class computes the RFC 1321 digest of the bytes passed to successive calls
+ * of update(); digest() pads the message and returns the 16-byte digest, after which the context is
+ * reset for a new message.
+ *
+ * The audio::md5::pipeline class updates a context on a worker thread of its own, so that hashing
+ * overlaps with the producer's work. buffer() returns a buffer of the requested size to fill, and
+ * submit() queues it for hashing; at most a few buffers are in flight, and their memory is recycled.
+ * digest() waits for the queued buffers and returns the digest of all of them, in submission order.
+ *
+ */
+
+
+namespace audio {
+namespace md5 {
+
+
+using digest_type = std::array<uint8_t, 16>;
+
+
+class context {
+public:
+	context();
+
+	void update(const std::byte *data, size_t size);
+	digest_type digest();
+
+private:
+	void _transform(const std::byte *block);
+
+	std::array<uint32_t, 4> _state;
+	uint64_t _size;                     // bytes
+	std::array<std::byte, 64> _buffer;  // partial block
+};
+
+
+class pipeline {
+public:
+	pipeline();
+
+	std::span<std::byte> buffer(size_t size);
+	void submit();
+	digest_type digest();
+
+private:
+	context _context;
+	thread_pool _pool;  // a single worker, hashing in submission order
+	std::deque<std::future<std::vector<std::byte>>> _jobs;
+	std::vector<std::byte> _buffer;
+
+	static constexpr size_t _max_job_count = 4;
+};
+
+
+} // namespace md5
+} // namespace audio
+
+
+#endif // AUDIO_MD5
@@ -0,0 +1,94 @@
+/* Copyright (C) 2024  Bogdan-Gabriel Alecu  (GameInstance.com)
+ *
+ * audio - C++ audio codecs.
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIO_MEMORY
+#define AUDIO_MEMORY
+
+#include <cstddef>
+#include <span>
+
+
+/*******************************************************************************************************
+ *
+ * @name  Memory streams
+ *
+ * @brief Input streams over contiguous memory.
+ *
+ * The audio::memory::input class is a non-owning input stream over a byte span that must outlive it.
+ * Codecs read it directly instead of going through a generic stream, and can reach any byte of it in
+ * constant time, which is what frame-parallel decoding and seeking rely on.
+ *
+ * The audio::memory::mapped_input class is a memory::input over a whole file mapped read-only into
+ * memory for its lifetime, so that decoding needs neither read system calls nor copies.
+ *
+ */
+
+
+namespace audio {
+namespace memory {
+
+
+class input {
+public:
+	explicit input(std::span<const std::byte> data);
+
+	inline std::span<const std::byte> data() const;
+	inline size_t size() const;
+
+private:
+	std::span<const std::byte> _data;
+};
+
+
+class mapped_input : public input {
+public:
+	explicit mapped_input(const char *path);
+	~mapped_input();
+
+	mapped_input(const mapped_input &) = delete;
+	mapped_input &operator=(const mapped_input &) = delete;
+
+private:
+	static std::span<const std::byte> _map(const char *path);
+};
+
+
+/******************************************************************************************************/
+
+
+inline input::input(std::span<const std::byte> data)
+	: _data{data}
+{
+}
+
+
+inline std::span<const std::byte> input::data() const
+{
+	return _data;
+}
+
+
+inline size_t input::size() const
+{
+	return _data.size();
+}
+
+
+} // namespace memory
+} // namespace audio
+
+
+#endif // AUDIO_MEMORY
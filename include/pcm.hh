@@ -0,0 +1,448 @@
+/* Copyright (C) 2024  Bogdan-Gabriel Alecu  (GameInstance.com)
+ *
+ * audio - C++ audio codecs.
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIO_PCM
+#define AUDIO_PCM
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <basics/error.hh>
+#include "buffer.hh"
+
+
+/*******************************************************************************************************
+ *
+ * @name  PCM packing
+ *
+ * @brief Interleaved little-endian PCM packing kernels.
+ *
+ * The audio::pcm::pack() function template interleaves count samples of every channel of a planar
+ * sample view and packs them as little-endian integers of sample_bit_size bits into a byte buffer of
+ * at least count * channel_count * sample_bit_size / 8 bytes. There is one kernel per sample byte size,
+ * further specialized for mono and stereo views. The overload taking a pcm::format is equivalent.
+ *
+ * The audio::pcm::pack_stereo() function template packs a joint-stereo pair of channels, as coded in
+ * stream order, undoing left-side, side-right or mid-side coding on the fly, so that a decoder can go
+ * from its subframes to interleaved PCM in a single pass. 16-bit output from 32-bit channels goes
+ * through the SSE2 or NEON stereo_kernel_16 where available.
+ *
+ * The audio::pcm::unpack() function template is the inverse of pack(): it reads count frames of
+ * interleaved little-endian PCM of the given format, sign-extends them and stores every channel into
+ * its plane of a planar sample view.
+ *
+ * The audio::pcm::convert() function template packs samples of sample_bit_size bits as another format:
+ * float32 normalizes them to [-1, 1), a wider integer format scales them up, and a narrower one
+ * requantizes them with TPDF dither from an audio::pcm::dither noise source, rounding and clipping to
+ * the target range. The same width is a plain pack(). Float and scaled-up samples get a lane-wise loop
+ * the compiler vectorizes; dithered ones draw two uniform values per sample from a xorshift generator.
+ *
+ */
+
+
+namespace audio {
+namespace pcm {
+
+
+enum class format : uint8_t {  // signed, little-endian
+	int8  = 8,
+	int16 = 16,
+	int24 = 24,
+	int32 = 32,
+	float32 = 0x80 | 32,  // IEEE 754, normalized to [-1, 1)
+};
+
+enum class stereo_coding : uint8_t {  // channel pair, in stream order
+	left_right,
+	left_side,   // side = left - right
+	side_right,
+	mid_side,    // mid = (left + right) >> 1
+};
+
+using stereo_kernel_type = void(*)(std::byte *out, const int32_t *first, const int32_t *second,
+																	size_t count, stereo_coding coding);
+
+extern const stereo_kernel_type stereo_kernel_16;  // nullptr if there is no vector unit
+
+
+class dither {  // TPDF noise source
+public:
+	explicit dither(uint64_t seed = 1);
+
+	inline int32_t tpdf(uint8_t bit_count);  // triangular over (-2^bit_count, 2^bit_count)
+
+private:
+	uint64_t _state;  // xorshift64, never zero
+};
+
+
+inline uint8_t sample_byte_size(format fmt);
+template<typename T>
+inline void pack(std::byte *out, const sample_view<T> &planar, size_t count, uint8_t sample_bit_size);
+template<typename T>
+inline void pack(std::byte *out, const sample_view<T> &planar, size_t count, format fmt);
+template<typename T, typename S>
+inline void pack_stereo(std::byte *out, const T *first, const S *second, size_t count,
+																	stereo_coding coding, format fmt);
+template<typename T>
+inline void unpack(const sample_view<T> &planar, const std::byte *in, size_t count, format fmt);
+template<typename T>
+inline void convert(std::byte *out, const sample_view<T> &planar, size_t count,
+													uint8_t sample_bit_size, format fmt, dither &noise);
+
+
+/******************************************************************************************************/
+
+
+static constexpr const char *_pcm_name = "audio::pcm";
+
+
+template<uint8_t SAMPLE_BYTE_SIZE>
+inline void _store_le(std::byte *out, int32_t value)
+{
+	if constexpr (std::endian::native == std::endian::little) {
+		std::memcpy(out, &value, SAMPLE_BYTE_SIZE);
+	} else {
+		for (uint8_t i = 0; i < SAMPLE_BYTE_SIZE; ++i)
+			out[i] = (std::byte)((value >> (8 * i)) & 0xff);
+	}
+}
+
+
+template<uint8_t SAMPLE_BYTE_SIZE, uint8_t CHANNEL_COUNT, typename T>
+inline void _pack(std::byte *out, const sample_view<T> &planar, size_t count)
+{   // O(N*channel_count); CHANNEL_COUNT 0 means planar.channel_count()
+	const auto channel_count = (CHANNEL_COUNT > 0) ? CHANNEL_COUNT : planar.channel_count();
+	const auto *data = planar.data();
+	const auto stride = planar.stride();
+
+	for (size_t i = 0; i < count; ++i)
+		for (uint8_t channel_idx = 0; channel_idx < channel_count; ++channel_idx) {
+			_store_le<SAMPLE_BYTE_SIZE>(out, data[channel_idx * stride + i]);
+			out += SAMPLE_BYTE_SIZE;
+		}
+}
+
+
+template<uint8_t SAMPLE_BYTE_SIZE, typename T>
+inline void _pack(std::byte *out, const sample_view<T> &planar, size_t count)
+{
+	switch (planar.channel_count()) {
+		case 1:
+			return _pack<SAMPLE_BYTE_SIZE, 1>(out, planar, count);
+		case 2:
+			return _pack<SAMPLE_BYTE_SIZE, 2>(out, planar, count);
+	}
+
+	_pack<SAMPLE_BYTE_SIZE, 0>(out, planar, count);
+}
+
+
+template<typename T>
+inline void pack(std::byte *out, const sample_view<T> &planar, size_t count, uint8_t sample_bit_size)
+{
+	switch (sample_bit_size) {
+		case 8:
+			return _pack<1>(out, planar, count);
+		case 16:
+			return _pack<2>(out, planar, count);
+		case 24:
+			return _pack<3>(out, planar, count);
+		case 32:
+			return _pack<4>(out, planar, count);
+	}
+
+	throw basics::error{"%s: (assertion failed) unexpected sample size (%ub)", _pcm_name,
+																					sample_bit_size};
+}
+
+
+inline uint8_t sample_byte_size(format fmt)
+{
+	switch (fmt) {
+		case format::int8:
+		case format::int16:
+		case format::int24:
+		case format::int32:
+			return (uint8_t)fmt / 8;
+		case format::float32:
+			return 4;
+	}
+
+	throw basics::error{"%s: (assertion failed) unexpected format (%u)", _pcm_name, (unsigned)fmt};
+}
+
+
+template<typename T>
+inline void pack(std::byte *out, const sample_view<T> &planar, size_t count, format fmt)
+{
+	if (fmt == format::float32)
+		throw basics::error{"%s: (assertion failed) float32 needs the sample size; see convert()",
+																							_pcm_name};
+
+	pack(out, planar, count, (uint8_t)fmt);
+}
+
+
+template<uint8_t SAMPLE_BYTE_SIZE, stereo_coding CODING, typename T, typename S>
+inline void _pack_stereo(std::byte *out, const T *first, const S *second, size_t count)
+{   // O(N); either channel may be a wider side channel
+	using W = std::common_type_t<T, S>;
+	for (size_t i = 0; i < count; ++i) {
+		W left, right;
+		if constexpr (CODING == stereo_coding::left_right) {
+			left = first[i];
+			right = second[i];
+		} else if constexpr (CODING == stereo_coding::left_side) {
+			left = first[i];
+			right = first[i] - second[i];
+		} else if constexpr (CODING == stereo_coding::side_right) {
+			left = first[i] + second[i];
+			right = second[i];
+		} else {
+			const W mid = ((W)first[i] << 1) | (second[i] & 1);  // odd side
+			left = (mid + second[i]) >> 1;
+			right = (mid - second[i]) >> 1;
+		}
+
+		_store_le<SAMPLE_BYTE_SIZE>(out, (int32_t)left);
+		_store_le<SAMPLE_BYTE_SIZE>(out + SAMPLE_BYTE_SIZE, (int32_t)right);
+		out += 2 * SAMPLE_BYTE_SIZE;
+	}
+}
+
+
+template<uint8_t SAMPLE_BYTE_SIZE, typename T, typename S>
+inline void _pack_stereo(std::byte *out, const T *first, const S *second, size_t count,
+																				stereo_coding coding)
+{
+	switch (coding) {
+		case stereo_coding::left_right:
+			return _pack_stereo<SAMPLE_BYTE_SIZE, stereo_coding::left_right>(out, first, second, count);
+		case stereo_coding::left_side:
+			return _pack_stereo<SAMPLE_BYTE_SIZE, stereo_coding::left_side>(out, first, second, count);
+		case stereo_coding::side_right:
+			return _pack_stereo<SAMPLE_BYTE_SIZE, stereo_coding::side_right>(out, first, second, count);
+		case stereo_coding::mid_side:
+			return _pack_stereo<SAMPLE_BYTE_SIZE, stereo_coding::mid_side>(out, first, second, count);
+	}
+}
+
+
+template<typename T, typename S>
+inline void pack_stereo(std::byte *out, const T *first, const S *second, size_t count,
+																	stereo_coding coding, format fmt)
+{
+	switch (fmt) {
+		case format::int8:
+			return _pack_stereo<1>(out, first, second, count, coding);
+		case format::int16:
+			if constexpr (std::is_same_v<T, int32_t> && std::is_same_v<S, int32_t>)
+				if (stereo_kernel_16 != nullptr)
+					return stereo_kernel_16(out, first, second, count, coding);
+			return _pack_stereo<2>(out, first, second, count, coding);
+		case format::int24:
+			return _pack_stereo<3>(out, first, second, count, coding);
+		case format::int32:
+			return _pack_stereo<4>(out, first, second, count, coding);
+		case format::float32:
+			break;
+	}
+
+	throw basics::error{"%s: (assertion failed) unexpected format (%u)", _pcm_name, (unsigned)fmt};
+}
+
+
+template<uint8_t SAMPLE_BYTE_SIZE>
+inline int32_t _load_le(const std::byte *in)
+{   // sign-extended
+	uint32_t value = 0;
+	if constexpr (std::endian::native == std::endian::little) {
+		std::memcpy(&value, in, SAMPLE_BYTE_SIZE);
+	} else {
+		for (uint8_t i = 0; i < SAMPLE_BYTE_SIZE; ++i)
+			value |= (uint32_t)in[i] << (8 * i);
+	}
+
+	constexpr auto shift = 32 - 8 * SAMPLE_BYTE_SIZE;
+
+	return (int32_t)(value << shift) >> shift;
+}
+
+
+template<uint8_t SAMPLE_BYTE_SIZE, uint8_t CHANNEL_COUNT, typename T>
+inline void _unpack(const sample_view<T> &planar, const std::byte *in, size_t count)
+{   // O(N*channel_count); CHANNEL_COUNT 0 means planar.channel_count()
+	const auto channel_count = (CHANNEL_COUNT > 0) ? CHANNEL_COUNT : planar.channel_count();
+	auto *data = planar.data();
+	const auto stride = planar.stride();
+
+	for (size_t i = 0; i < count; ++i)
+		for (uint8_t channel_idx = 0; channel_idx < channel_count; ++channel_idx) {
+			data[channel_idx * stride + i] = _load_le<SAMPLE_BYTE_SIZE>(in);
+			in += SAMPLE_BYTE_SIZE;
+		}
+}
+
+
+template<uint8_t SAMPLE_BYTE_SIZE, typename T>
+inline void _unpack(const sample_view<T> &planar, const std::byte *in, size_t count)
+{
+	switch (planar.channel_count()) {
+		case 1:
+			return _unpack<SAMPLE_BYTE_SIZE, 1>(planar, in, count);
+		case 2:
+			return _unpack<SAMPLE_BYTE_SIZE, 2>(planar, in, count);
+	}
+
+	_unpack<SAMPLE_BYTE_SIZE, 0>(planar, in, count);
+}
+
+
+template<typename T>
+inline void unpack(const sample_view<T> &planar, const std::byte *in, size_t count, format fmt)
+{
+	switch (fmt) {
+		case format::int8:
+			return _unpack<1>(planar, in, count);
+		case format::int16:
+			return _unpack<2>(planar, in, count);
+		case format::int24:
+			return _unpack<3>(planar, in, count);
+		case format::int32:
+			return _unpack<4>(planar, in, count);
+		case format::float32:
+			break;
+	}
+
+	throw basics::error{"%s: (assertion failed) unexpected format (%u)", _pcm_name, (unsigned)fmt};
+}
+
+
+inline dither::dither(uint64_t seed)
+	: _state{(seed != 0) ? seed : 1}
+{
+}
+
+
+inline int32_t dither::tpdf(uint8_t bit_count)
+{   // the difference of two uniform values of bit_count bits, from the top of one draw each
+	_state ^= _state << 13;
+	_state ^= _state >> 7;
+	_state ^= _state << 17;
+
+	const auto shift = 32 - bit_count;
+
+	return (int32_t)((uint32_t)_state >> shift) - (int32_t)((uint32_t)(_state >> 32) >> shift);
+}
+
+
+template<uint8_t SAMPLE_BYTE_SIZE, uint8_t CHANNEL_COUNT, typename T, typename CONVERSION>
+inline void _convert(std::byte *out, const sample_view<T> &planar, size_t count, CONVERSION conversion)
+{   // O(N*channel_count); CHANNEL_COUNT 0 means planar.channel_count()
+	const auto channel_count = (CHANNEL_COUNT > 0) ? CHANNEL_COUNT : planar.channel_count();
+	const auto *data = planar.data();
+	const auto stride = planar.stride();
+
+	for (size_t i = 0; i < count; ++i)
+		for (uint8_t channel_idx = 0; channel_idx < channel_count; ++channel_idx) {
+			_store_le<SAMPLE_BYTE_SIZE>(out, conversion(data[channel_idx * stride + i]));
+			out += SAMPLE_BYTE_SIZE;
+		}
+}
+
+
+template<uint8_t SAMPLE_BYTE_SIZE, typename T, typename CONVERSION>
+inline void _convert(std::byte *out, const sample_view<T> &planar, size_t count, CONVERSION conversion)
+{
+	switch (planar.channel_count()) {
+		case 1:
+			return _convert<SAMPLE_BYTE_SIZE, 1>(out, planar, count, conversion);
+		case 2:
+			return _convert<SAMPLE_BYTE_SIZE, 2>(out, planar, count, conversion);
+	}
+
+	_convert<SAMPLE_BYTE_SIZE, 0>(out, planar, count, conversion);
+}
+
+
+template<uint8_t SAMPLE_BYTE_SIZE, typename T>
+inline void _convert(std::byte *out, const sample_view<T> &planar, size_t count,
+																uint8_t sample_bit_size, dither &noise)
+{   // to SAMPLE_BYTE_SIZE bytes, from sample_bit_size bits
+	constexpr auto bit_size = 8 * SAMPLE_BYTE_SIZE;
+	if (sample_bit_size < bit_size) {
+		const auto shift = bit_size - sample_bit_size;
+
+		return _convert<SAMPLE_BYTE_SIZE>(out, planar, count, [shift](T sample) {
+			return (int32_t)((uint32_t)sample << shift);
+		});
+	}
+
+	const auto shift = (uint8_t)(sample_bit_size - bit_size);
+	constexpr auto max = (int64_t)((1ull << (bit_size - 1)) - 1);
+	_convert<SAMPLE_BYTE_SIZE>(out, planar, count, [shift, &noise, max](T sample) {
+		const auto value = ((int64_t)sample + noise.tpdf(shift) + (1 << (shift - 1))) >> shift;
+
+		return (int32_t)std::clamp<int64_t>(value, -max - 1, max);
+	});
+}
+
+
+template<typename T>
+inline void convert(std::byte *out, const sample_view<T> &planar, size_t count,
+													uint8_t sample_bit_size, format fmt, dither &noise)
+{   // O(N*channel_count)
+	if ((sample_bit_size == 0) || (sample_bit_size > 32))
+		throw basics::error{"%s: (assertion failed) unexpected sample size (%ub)", _pcm_name,
+																					sample_bit_size};
+
+	if (fmt == format::float32) {
+		const auto scale = std::ldexp(1.0f, 1 - sample_bit_size);
+
+		return _convert<4>(out, planar, count, [scale](T sample) {
+			return std::bit_cast<int32_t>((float)sample * scale);
+		});
+	}
+	if (sample_bit_size == (uint8_t)fmt)
+		return pack(out, planar, count, fmt);
+
+	switch (fmt) {
+		case format::int8:
+			return _convert<1>(out, planar, count, sample_bit_size, noise);
+		case format::int16:
+			return _convert<2>(out, planar, count, sample_bit_size, noise);
+		case format::int24:
+			return _convert<3>(out, planar, count, sample_bit_size, noise);
+		case format::int32:
+			return _convert<4>(out, planar, count, sample_bit_size, noise);
+		case format::float32:
+			break;
+	}
+
+	throw basics::error{"%s: (assertion failed) unexpected format (%u)", _pcm_name, (unsigned)fmt};
+}
+
+
+} // namespace pcm
+} // namespace audio
+
+
+#endif // AUDIO_PCM
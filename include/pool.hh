@@ -0,0 +1,101 @@
+/* Copyright (C) 2024  Bogdan-Gabriel Alecu  (GameInstance.com)
+ *
+ * audio - C++ audio codecs.
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIO_POOL
+#define AUDIO_POOL
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+
+/*******************************************************************************************************
+ *
+ * @name  Thread pool
+ *
+ * @brief A fixed-size pool of worker threads.
+ *
+ * The audio::thread_pool class runs submitted jobs on thread_count() worker threads, in submission
+ * order. The submit() member function returns a std::future for the job's result; exceptions thrown by
+ * the job are rethrown by the future. The destructor finishes the queued jobs and joins the workers.
+ *
+ */
+
+
+namespace audio {
+
+
+class thread_pool {
+public:
+	explicit thread_pool(size_t thread_count = 0);  // 0 means one per hardware thread
+	~thread_pool();
+
+	thread_pool(const thread_pool &) = delete;
+	thread_pool &operator=(const thread_pool &) = delete;
+
+	template<typename JOB>
+	std::future<std::invoke_result_t<JOB>> submit(JOB &&job);
+	inline size_t thread_count() const;
+
+private:
+	void _work();
+
+	std::vector<std::thread> _threads;
+	std::deque<std::function<void()>> _jobs;
+	std::mutex _mutex;
+	std::condition_variable _condition;
+	bool _is_stopping;
+};
+
+
+/******************************************************************************************************/
+
+
+template<typename JOB>
+std::future<std::invoke_result_t<JOB>> thread_pool::submit(JOB &&job)
+{
+	// std::function needs a copyable target, hence the shared task
+	using task_type = std::packaged_task<std::invoke_result_t<JOB>()>;
+	auto task = std::make_shared<task_type>(std::forward<JOB>(job));
+	auto res = task->get_future();
+	{
+		std::lock_guard lock{_mutex};
+		_jobs.emplace_back([task]() { (*task)(); });
+	}
+	_condition.notify_one();
+
+	return res;
+}
+
+
+inline size_t thread_pool::thread_count() const
+{
+	return _threads.size();
+}
+
+
+} // namespace audio
+
+
+#endif // AUDIO_POOL
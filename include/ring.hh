@@ -0,0 +1,155 @@
+/* Copyright (C) 2024  Bogdan-Gabriel Alecu  (GameInstance.com)
+ *
+ * audio - C++ audio codecs.
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef AUDIO_RING
+#define AUDIO_RING
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+#include <basics/error.hh>
+#include "buffer.hh"
+
+
+/*******************************************************************************************************
+ *
+ * @name  SPSC ring
+ *
+ * @brief A lock-free single-producer single-consumer ring of reusable slots.
+ *
+ * The audio::spsc_ring class template hands capacity slots of T from one producer thread to one
+ * consumer thread in order, without locks or copies: the producer fills the slot returned by back()
+ * and publishes it with push(), the consumer reads the slot returned by front() and frees it with
+ * pop(). Slots are constructed once and reused, so that buffers they own keep their capacity. A full
+ * ring blocks back() and an empty one blocks front(), by waiting on the atomic index of the other
+ * side. Either side may close() the ring: back() then returns nullptr, and front() does so once the
+ * slots pushed before are consumed, e.g. so that a failing consumer doesn't leave the producer waiting.
+ *
+ */
+
+
+namespace audio {
+
+
+template<typename T>
+class spsc_ring {
+public:
+	explicit spsc_ring(size_t capacity);
+
+	spsc_ring(const spsc_ring &) = delete;
+	spsc_ring &operator=(const spsc_ring &) = delete;
+
+	inline T *back();   // producer; nullptr once closed
+	inline void push();
+	inline T *front();  // consumer; nullptr once closed and drained
+	inline void pop();
+	inline void close();
+	inline size_t capacity() const;
+
+private:
+	std::vector<T> _slots;
+	alignas(cache_line_size) std::atomic<size_t> _head;  // slots popped, and the closed bit
+	alignas(cache_line_size) std::atomic<size_t> _tail;  // slots pushed, and the closed bit
+
+	static constexpr size_t _closed_bit = (size_t)1 << (8 * sizeof(size_t) - 1);
+};
+
+
+/******************************************************************************************************/
+
+
+static constexpr const char *_ring_name = "audio::spsc_ring";
+
+
+template<typename T>
+spsc_ring<T>::spsc_ring(size_t capacity)
+	: _slots(capacity), _head{0}, _tail{0}
+{
+	if (capacity == 0)
+		throw basics::error{"%s: (assertion failed) empty ring", _ring_name};
+}
+
+
+template<typename T>
+inline T *spsc_ring<T>::back()
+{
+	const auto tail = _tail.load(std::memory_order_relaxed) & ~_closed_bit;
+	for (;;) {
+		const auto head = _head.load(std::memory_order_acquire);
+		if ((head & _closed_bit) != 0)
+			return nullptr;
+		if (tail - head < _slots.size())
+			return &_slots[tail % _slots.size()];
+
+		_head.wait(head, std::memory_order_acquire);
+	}
+}
+
+
+template<typename T>
+inline void spsc_ring<T>::push()
+{
+	_tail.fetch_add(1, std::memory_order_release);
+	_tail.notify_one();
+}
+
+
+template<typename T>
+inline T *spsc_ring<T>::front()
+{
+	const auto head = _head.load(std::memory_order_relaxed) & ~_closed_bit;
+	for (;;) {
+		const auto tail = _tail.load(std::memory_order_acquire);
+		if ((tail & ~_closed_bit) != head)
+			return &_slots[head % _slots.size()];
+		if ((tail & _closed_bit) != 0)
+			return nullptr;
+
+		_tail.wait(tail, std::memory_order_acquire);
+	}
+}
+
+
+template<typename T>
+inline void spsc_ring<T>::pop()
+{
+	_head.fetch_add(1, std::memory_order_release);
+	_head.notify_one();
+}
+
+
+template<typename T>
+inline void spsc_ring<T>::close()
+{
+	_head.fetch_or(_closed_bit, std::memory_order_release);
+	_tail.fetch_or(_closed_bit, std::memory_order_release);
+	_head.notify_one();
+	_tail.notify_one();
+}
+
+
+template<typename T>
+inline size_t spsc_ring<T>::capacity() const
+{
+	return _slots.size();
+}
+
+
+} // namespace audio
+
+
+#endif // AUDIO_RING
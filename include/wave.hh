@@ -17,9 +17,20 @@
 #ifndef AUDIO_WAVE
 #define AUDIO_WAVE
 
+#include <algorithm>
+#include <bit>
+#include <concepts>
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <span>
+#include <type_traits>
+#include <vector>
 #include <basics/error.hh>
+#include "bit.hh"
+#include "buffer.hh"
+#include "memory.hh"
+#include "pcm.hh"
 
 
 /*******************************************************************************************************
@@ -32,7 +43,36 @@
  * The encode_header() member function encodes the streaminfo object and writes it to the ostream wave
  * audio stream. It must be called before any audio samples are encoded. The encode_sample() member
  * function encodes one sample into the audio stream and should be called mindful of the number and
- * order of channels.
+ * order of channels. The encode_block() member function interleaves and packs the first count samples
+ * of every channel of a planar view into a member byte buffer and writes it to ostream at once. The
+ * encode_pcm() member function writes samples already packed as interleaved little-endian PCM, signed
+ * as pcm::pack() has them; 8-bit samples are stored unsigned, as WAVE wants them, by all three. A
+ * streaminfo with is_float set writes a WAVE_FORMAT_IEEE_FLOAT stream of 32-bit floats, with the fact
+ * chunk such streams need; encode_block() then takes float or double views, and encode_pcm() float32
+ * PCM, e.g. from pcm::convert().
+ *
+ * A streaminfo sample_count of zero stands for an unknown length: encode_header() then writes all ones
+ * for the RIFF and data chunk sizes, as streaming writers do for pipes and sockets. Over a seekable
+ * ostream, one with seek() and position() members, finish() goes back to patch both sizes from the
+ * bytes actually written, whether the sample count was unknown or not. An odd-sized data chunk gets
+ * its pad byte, unless its size is left unknown. The destructor calls finish(), but can't report its
+ * errors.
+ *
+ * The audio::wave::decoder class template reads a RIFF WAVE stream from istream. The decode_header()
+ * member function walks the chunks up to the data chunk, skipping all but the fmt chunk, which must
+ * describe integer PCM, either plainly or as WAVE_FORMAT_EXTENSIBLE; the streaminfo sample_bit_size
+ * is then the valid bit count and channel_mask() returns the speaker mask. The state() member function
+ * returns *init* after construction, *has_header* after decode_header() and *complete* once
+ * decode_audio() finds no more samples. After each call to decode_audio(), block_data() returns a
+ * planar view of block_size() samples per channel, up to BUFFER_SIZE, over the member buffer: 8-bit
+ * samples are unsigned in WAVE and come out signed, and samples narrower than their container are
+ * shifted down. A data chunk size of zero or all ones, as left by streaming writers, reads up to the
+ * end of istream.
+ *
+ * Decoders over a memory::input stream, e.g. a memory::mapped_input, unpack straight from istream,
+ * and data() returns the whole data chunk in place. The samples() member function template views it
+ * as interleaved samples of type T, whose size must match the sample container, without copying a
+ * byte; the samples are little-endian and left-justified in their container, as stored.
  *
  */
 
@@ -46,6 +86,7 @@ struct streaminfo_type {
 	uint8_t sample_bit_size;
 	uint8_t channel_count;
 	uint64_t sample_count;
+	bool is_float{false};  // IEEE 754 samples, 32-bit only
 };
 
 template<typename OUTPUT_STREAM>
@@ -57,10 +98,30 @@ public:
 
 	void encode_header(const streaminfo_type &streaminfo);
 	void encode_sample(int32_t sample);
+	template<typename T>
+	void encode_block(const sample_view<T> &planar, size_t count);
+	void encode_pcm(std::span<const std::byte> data);
+	void finish();
+
+	inline uint64_t data_byte_size() const;  // written so far
 
 private:
 	OUTPUT_STREAM &_ostream;
 	streaminfo_type _streaminfo;
+	std::vector<std::byte> _block_buffer;
+	size_t _header_position;   // of the RIFF chunk, in seekable streams
+	uint32_t _header_size;       // from the WAVE id to the audio data
+	uint32_t _header_data_size;  // as written by encode_header()
+	uint64_t _data_byte_size;
+	bool _is_finished;
+
+	static constexpr bool _is_seekable = requires(OUTPUT_STREAM &ostream, size_t position) {
+		ostream.seek(position);
+		{ ostream.position() } -> std::convertible_to<size_t>;
+	};
+
+	void _write(const std::byte *data, size_t size);
+	void _write_pcm(const std::byte *data, size_t size);
 
 	void _put_string(const char *value);
 	void _put_int32(int32_t value);
@@ -70,19 +131,80 @@ private:
 };
 
 
+enum class decoder_state {
+	init,
+	has_header,
+	complete,
+};
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE = 8192>
+class decoder {
+public:
+	using state_type = decoder_state;
+
+	explicit decoder(INPUT_STREAM &istream);
+
+	void decode_header();
+	void decode_audio();
+	template<typename T>
+	std::span<const T> samples() const;  // memory::input streams only
+
+	inline const decoder_state &state() const;
+	inline const streaminfo_type &streaminfo() const;
+	inline uint32_t channel_mask() const;  // zero unless WAVE_FORMAT_EXTENSIBLE
+	inline uint8_t container_bit_size() const;
+	inline sample_view<const int32_t> block_data() const;
+	inline const size_t &block_size() const;
+	inline std::span<const std::byte> data() const;  // memory::input streams only
+	inline size_t position() const;
+
+private:
+	inline void _decode_format(uint32_t chunk_size);
+	inline void _decode_data(uint32_t chunk_size);
+	inline const std::byte *_read(size_t &count);
+	inline uint32_t _get_uint(uint8_t byte_count);
+	inline void _skip(size_t byte_count);
+	inline size_t _frame_byte_size() const;
+
+	bit::source<INPUT_STREAM> _istream;
+	state_type _state;
+	streaminfo_type _streaminfo;
+	uint32_t _channel_mask;
+	uint8_t _container_bit_size;
+	size_t _data_position;     // of the first sample
+	uint64_t _remaining_count;  // samples per channel, all ones if unknown
+	size_t _block_size;
+	std::vector<int32_t, aligned_allocator<int32_t>> _buffer;  // planar, _channel_stride apart
+	std::vector<std::byte> _pcm_buffer;  // generic streams only
+
+	static constexpr bool _is_memory = std::derived_from<INPUT_STREAM, memory::input>;
+	static constexpr size_t _channel_stride = aligned_stride<int32_t>(BUFFER_SIZE);
+};
+
+
 /******************************************************************************************************/
 
 
+static constexpr uint32_t _pcm_header_size = 4 + 8 + 16 + 8;  // WAVE, fmt chunk, data chunk header
+static constexpr uint32_t _float_header_size = 4 + 8 + 18 + 8 + 4 + 8;  // and the fact chunk
+static constexpr uint32_t _unknown_chunk_size = 0xffffffff;
+static constexpr uint16_t _pcm_format_tag = 0x0001;
+static constexpr uint16_t _float_format_tag = 0x0003;
+static constexpr uint16_t _extensible_format_tag = 0xfffe;
+
+
 template<typename OUTPUT_STREAM>
 encoder<OUTPUT_STREAM>::encoder(OUTPUT_STREAM &ostream)
-	: _ostream{ostream}, _streaminfo{}
+	: _ostream{ostream}, _streaminfo{}, _header_position{0}, _header_size{_pcm_header_size},
+	  _header_data_size{0}, _data_byte_size{0}, _is_finished{true}
 {
 }
 
 
 template<typename OUTPUT_STREAM>
 encoder<OUTPUT_STREAM>::encoder(OUTPUT_STREAM &ostream, const streaminfo_type &streaminfo)
-	: _ostream{ostream}, _streaminfo{}
+	: encoder{ostream}
 {
 	encode_header(streaminfo);
 }
@@ -91,22 +213,39 @@ encoder<OUTPUT_STREAM>::encoder(OUTPUT_STREAM &ostream, const streaminfo_type &s
 template<typename OUTPUT_STREAM>
 encoder<OUTPUT_STREAM>::~encoder()
 {
-	_ostream.flush();
+	try {
+		finish();
+	} catch (const basics::error &) {  // finish() first to see them
+	}
 }
 
 
 template<typename OUTPUT_STREAM>
 void encoder<OUTPUT_STREAM>::encode_header(const streaminfo_type &info)
 {
+	if (info.is_float && (info.sample_bit_size != 32))
+		throw basics::error{"audio::wave::encoder: (assertion failed) "
+									"expecting 32-bit float samples; got %ub", info.sample_bit_size};
+	if constexpr (_is_seekable)
+		_header_position = _ostream.position();
+
+	_header_size = info.is_float ? _float_header_size : _pcm_header_size;
+	const auto data_size = info.channel_count * info.sample_count * ((info.sample_bit_size + 7) / 8);
+	const auto is_oversized = data_size > _unknown_chunk_size - _header_size - 1;
+	_header_data_size = ((info.sample_count == 0) || is_oversized) ? _unknown_chunk_size :
+																					(uint32_t)data_size;
+	_data_byte_size = 0;
+	_is_finished = false;
+
 	_put_string("RIFF");
-	auto data_size = info.channel_count * info.sample_count * info.sample_bit_size;
-	_put_int32(4 + 8 + 16 + 8 + data_size);
+	_put_int32((_header_data_size == _unknown_chunk_size) ? _unknown_chunk_size :
+											_header_size + _header_data_size + _header_data_size % 2);
 	_put_string("WAVE");
 
 	_put_string("fmt ");
-	_put_int32(16);
+	_put_int32(info.is_float ? 18 : 16);
 
-	_put_int16(1);
+	_put_int16(info.is_float ? _float_format_tag : _pcm_format_tag);
 	_put_int16(info.channel_count);
 	_put_int32(info.sample_rate);
 
@@ -115,9 +254,17 @@ void encoder<OUTPUT_STREAM>::encode_header(const streaminfo_type &info)
 	_put_int32(byte_rate);
 	_put_int16(frame_size);
 	_put_int16(info.sample_bit_size); // Bits per sample
+	if (info.is_float) {
+		_put_int16(0);  // no extension
+
+		_put_string("fact");
+		_put_int32(4);
+		_put_int32((_header_data_size == _unknown_chunk_size) ? _unknown_chunk_size :  // per channel
+																		_header_data_size / frame_size);
+	}
 
 	_put_string("data");
-	_put_int32(data_size);
+	_put_int32(_header_data_size);
 
 	_streaminfo = info;
 }
@@ -126,9 +273,14 @@ void encoder<OUTPUT_STREAM>::encode_header(const streaminfo_type &info)
 template<typename OUTPUT_STREAM>
 void encoder<OUTPUT_STREAM>::encode_sample(int32_t sample)
 {
+	if (_streaminfo.is_float)
+		throw basics::error{"audio::wave::encoder: (assertion failed) "
+																	"float streams take float samples"};
+
+	_data_byte_size += _streaminfo.sample_bit_size / 8;
 	switch (_streaminfo.sample_bit_size) {
 		case 8:
-			_put_int8(sample);
+			_put_int8(sample ^ -128);  // unsigned
 			break;
 		case 16:
 			_put_int16(sample);
@@ -146,6 +298,112 @@ void encoder<OUTPUT_STREAM>::encode_sample(int32_t sample)
 }
 
 
+template<typename OUTPUT_STREAM>
+template<typename T>
+void encoder<OUTPUT_STREAM>::encode_block(const sample_view<T> &planar, size_t count)
+{   // O(N*channel_count)
+	if (planar.channel_count() != _streaminfo.channel_count)
+		throw basics::error{"audio::wave::encoder: (assertion failed) expecting %u channels; got %u",
+												_streaminfo.channel_count, planar.channel_count()};
+
+	if (std::is_floating_point_v<T> != _streaminfo.is_float)
+		throw basics::error{"audio::wave::encoder: (assertion failed) "
+															"float streams take float samples, only"};
+
+	const auto byte_size = count * _streaminfo.channel_count * (_streaminfo.sample_bit_size / 8);
+	if (_block_buffer.size() < byte_size)
+		_block_buffer.resize(byte_size);
+
+	if constexpr (std::is_floating_point_v<T>) {
+		auto *out = _block_buffer.data();
+		for (size_t i = 0; i < count; ++i)
+			for (uint8_t channel_idx = 0; channel_idx < planar.channel_count(); ++channel_idx) {
+				const auto value = std::bit_cast<uint32_t>((float)planar[channel_idx][i]);
+				for (uint8_t j = 0; j < 4; ++j)
+					*out++ = (std::byte)(value >> (8 * j));
+			}
+	} else {
+		pcm::pack(_block_buffer.data(), planar, count, _streaminfo.sample_bit_size);
+	}
+	_write_pcm(_block_buffer.data(), byte_size);
+}
+
+
+template<typename OUTPUT_STREAM>
+void encoder<OUTPUT_STREAM>::encode_pcm(std::span<const std::byte> data)
+{   // O(N)
+	_write_pcm(data.data(), data.size());
+}
+
+
+template<typename OUTPUT_STREAM>
+void encoder<OUTPUT_STREAM>::finish()
+{
+	if (_is_finished)
+		return;
+	_is_finished = true;
+
+	// RIFF chunks are word aligned; data of unknown size runs to the end of the stream instead
+	if ((_data_byte_size % 2 == 1) && (_is_seekable || (_header_data_size != _unknown_chunk_size)))
+		_ostream.put(0);
+
+	if constexpr (_is_seekable) {
+		const auto data_size = (_data_byte_size > _unknown_chunk_size - _header_size - 1) ?
+												_unknown_chunk_size : (uint32_t)_data_byte_size;
+		if (data_size != _header_data_size) {
+			const auto end = _ostream.position();
+			_ostream.seek(_header_position + 4);
+			_put_int32((data_size == _unknown_chunk_size) ? _unknown_chunk_size :
+															_header_size + data_size + data_size % 2);
+			if (_streaminfo.is_float) {
+				_ostream.seek(_header_position + 8 + 4 + 8 + 18 + 8);
+				_put_int32((data_size == _unknown_chunk_size) ? _unknown_chunk_size :
+														data_size / (4 * _streaminfo.channel_count));
+			}
+			_ostream.seek(_header_position + 8 + _header_size - 4);
+			_put_int32(data_size);
+			_ostream.seek(end);
+		}
+	}
+
+	_ostream.flush();
+}
+
+
+template<typename OUTPUT_STREAM>
+inline uint64_t encoder<OUTPUT_STREAM>::data_byte_size() const
+{
+	return _data_byte_size;
+}
+
+
+template<typename OUTPUT_STREAM>
+void encoder<OUTPUT_STREAM>::_write(const std::byte *data, size_t size)
+{
+	if constexpr (requires { _ostream.write((const char *)data, size); }) {
+		_ostream.write((const char *)data, size);
+	} else {
+		for (size_t i = 0; i < size; ++i)
+			_ostream.put((char)data[i]);
+	}
+}
+
+
+template<typename OUTPUT_STREAM>
+void encoder<OUTPUT_STREAM>::_write_pcm(const std::byte *data, size_t size)
+{   // O(N); 8-bit samples in place if they are the block buffer
+	_data_byte_size += size;
+	if (_streaminfo.sample_bit_size != 8)
+		return _write(data, size);
+
+	if (_block_buffer.size() < size)
+		_block_buffer.resize(size);
+	for (size_t i = 0; i < size; ++i)
+		_block_buffer[i] = data[i] ^ std::byte{0x80};
+	_write(_block_buffer.data(), size);
+}
+
+
 template<typename OUTPUT_STREAM>
 void encoder<OUTPUT_STREAM>::_put_string(const char *value)
 {
@@ -188,6 +446,297 @@ void encoder<OUTPUT_STREAM>::_put_int8(int8_t value)
 }
 
 
+static constexpr const char *_decoder_name = "audio::wave::decoder";
+static constexpr uint32_t _unknown_data_size = 0xffffffff;
+
+
+constexpr uint32_t _fourcc(const char (&id)[5])
+{
+	return (uint32_t)id[0] | (uint32_t)id[1] << 8 | (uint32_t)id[2] << 16 | (uint32_t)id[3] << 24;
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE>
+decoder<INPUT_STREAM, BUFFER_SIZE>::decoder(INPUT_STREAM &upstream)
+	: _istream{upstream}, _state{state_type::init}, _streaminfo{}, _channel_mask{0},
+	  _container_bit_size{0}, _data_position{0}, _remaining_count{0}, _block_size{0}, _buffer{},
+	  _pcm_buffer{}
+{
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE>
+void decoder<INPUT_STREAM, BUFFER_SIZE>::decode_header()
+{
+	if (_get_uint(4) != _fourcc("RIFF"))
+		throw basics::error{"%s: (protocol error) unexpected RIFF marker", _decoder_name};
+	_get_uint(4);  // RIFF size, unreliable in streamed files
+	if (_get_uint(4) != _fourcc("WAVE"))
+		throw basics::error{"%s: (protocol error) unexpected WAVE marker", _decoder_name};
+
+	bool has_format{false};
+	for (;;) {
+		const auto chunk_id = _get_uint(4);
+		const auto chunk_size = _get_uint(4);
+
+		if (chunk_id == _fourcc("data")) {
+			if (!has_format)
+				throw basics::error{"%s: (protocol error) data chunk before fmt chunk", _decoder_name};
+			_decode_data(chunk_size);
+			break;
+		} else if (chunk_id == _fourcc("fmt ")) {
+			_decode_format(chunk_size);
+			has_format = true;
+		} else {  // OTHER CHUNKS
+			_skip(chunk_size);
+		}
+		_skip(chunk_size & 1);  // chunks are padded to an even size
+	}
+
+	_buffer.assign(_channel_stride * _streaminfo.channel_count, 0);
+	_state = state_type::has_header;
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE>
+void decoder<INPUT_STREAM, BUFFER_SIZE>::decode_audio()
+{   // O(N)
+	auto count = (size_t)std::min<uint64_t>(BUFFER_SIZE, _remaining_count);
+	const auto *pcm_data = _read(count);
+
+	_block_size = count;
+	if (count == 0) {
+		_state = state_type::complete;
+
+		return;
+	}
+	if (_remaining_count != ~uint64_t{0})
+		_remaining_count -= count;
+
+	const auto planar = sample_view<int32_t>{_buffer.data(), _channel_stride,
+																	_streaminfo.channel_count, count};
+	pcm::unpack(planar, pcm_data, count, (pcm::format)_container_bit_size);
+
+	const auto shift = _container_bit_size - _streaminfo.sample_bit_size;
+	if (_container_bit_size == 8) {  // unsigned
+		for (uint8_t channel_idx = 0; channel_idx < planar.channel_count(); ++channel_idx)
+			for (auto &sample: planar[channel_idx])
+				sample = (sample ^ -128) >> shift;
+	} else if (shift > 0) {
+		for (uint8_t channel_idx = 0; channel_idx < planar.channel_count(); ++channel_idx)
+			for (auto &sample: planar[channel_idx])
+				sample >>= shift;
+	}
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE>
+template<typename T>
+std::span<const T> decoder<INPUT_STREAM, BUFFER_SIZE>::samples() const
+{   // O(1)
+	static_assert(std::endian::native == std::endian::little, "samples are stored little-endian");
+
+	if (sizeof(T) * 8 != _container_bit_size)
+		throw basics::error{"%s: (assertion failed) cannot view %ub samples as %zub", _decoder_name,
+																	_container_bit_size, sizeof(T) * 8};
+
+	const auto bytes = data();
+	if ((uintptr_t)bytes.data() % alignof(T) != 0)
+		throw basics::error{"%s: (assertion failed) data chunk at %zu is misaligned for %zub samples",
+														_decoder_name, _data_position, sizeof(T) * 8};
+
+	return {reinterpret_cast<const T *>(bytes.data()), bytes.size() / sizeof(T)};
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE>
+inline const decoder_state &decoder<INPUT_STREAM, BUFFER_SIZE>::state() const
+{
+	return _state;
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE>
+inline const streaminfo_type &decoder<INPUT_STREAM, BUFFER_SIZE>::streaminfo() const
+{
+	return _streaminfo;
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE>
+inline uint32_t decoder<INPUT_STREAM, BUFFER_SIZE>::channel_mask() const
+{
+	return _channel_mask;
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE>
+inline uint8_t decoder<INPUT_STREAM, BUFFER_SIZE>::container_bit_size() const
+{
+	return _container_bit_size;
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE>
+inline sample_view<const int32_t> decoder<INPUT_STREAM, BUFFER_SIZE>::block_data() const
+{
+	return {_buffer.data(), _channel_stride, _streaminfo.channel_count, _block_size};
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE>
+inline const size_t &decoder<INPUT_STREAM, BUFFER_SIZE>::block_size() const
+{
+	return _block_size;
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE>
+inline std::span<const std::byte> decoder<INPUT_STREAM, BUFFER_SIZE>::data() const
+{
+	static_assert(_is_memory, "data chunk views need memory input");
+
+	return _istream.data().subspan(_data_position, _streaminfo.sample_count * _frame_byte_size());
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE>
+inline size_t decoder<INPUT_STREAM, BUFFER_SIZE>::position() const
+{
+	return _istream.position();
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE>
+inline void decoder<INPUT_STREAM, BUFFER_SIZE>::_decode_format(uint32_t chunk_size)
+{
+	if (chunk_size < 16)
+		throw basics::error{"%s: (protocol error) unexpected fmt chunk size (%u)",
+																			_decoder_name, chunk_size};
+
+	auto format_tag = _get_uint(2);
+	const auto channel_count = _get_uint(2);
+	_streaminfo.sample_rate = _get_uint(4);
+	_get_uint(4);  // byte rate
+	const auto block_align = _get_uint(2);
+	const auto container_bit_size = _get_uint(2);
+	auto sample_bit_size = container_bit_size;
+	uint32_t byte_count = 16;
+
+	if ((format_tag == _extensible_format_tag) && (chunk_size >= 40)) {  // WAVE_FORMAT_EXTENSIBLE
+		_get_uint(2);  // extension size
+		if (const auto valid_bit_size = _get_uint(2); valid_bit_size > 0)
+			sample_bit_size = valid_bit_size;
+		_channel_mask = _get_uint(4);
+		format_tag = _get_uint(2);  // the sub-format GUID starts with the format tag
+		_skip(14);
+		byte_count = 40;
+	}
+	_skip(chunk_size - byte_count);
+
+	if (format_tag != _pcm_format_tag)
+		throw basics::error{"%s: (protocol error) unsupported format (0x%04x)",
+																			_decoder_name, format_tag};
+	if ((channel_count == 0) || (channel_count > 255))
+		throw basics::error{"%s: (protocol error) unsupported channel count (%u)",
+																		_decoder_name, channel_count};
+	if ((container_bit_size == 0) || (container_bit_size > 32) || (container_bit_size % 8 != 0))
+		throw basics::error{"%s: (protocol error) unsupported sample size (%ub)",
+																	_decoder_name, container_bit_size};
+	if (sample_bit_size > container_bit_size)
+		throw basics::error{"%s: (protocol error) unexpected valid sample size (%ub of %ub)",
+													_decoder_name, sample_bit_size, container_bit_size};
+	if (block_align != channel_count * container_bit_size / 8)
+		throw basics::error{"%s: (protocol error) unexpected block alignment (%u)",
+																			_decoder_name, block_align};
+	if (_streaminfo.sample_rate == 0)
+		throw basics::error{"%s: (protocol error) unexpected sample rate (0)", _decoder_name};
+
+	_streaminfo.channel_count = channel_count;
+	_streaminfo.sample_bit_size = sample_bit_size;
+	_container_bit_size = container_bit_size;
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE>
+inline void decoder<INPUT_STREAM, BUFFER_SIZE>::_decode_data(uint32_t chunk_size)
+{
+	const auto is_sized = (chunk_size != 0) && (chunk_size != _unknown_data_size);
+	const auto frame_byte_size = _frame_byte_size();
+	_data_position = _istream.position();
+
+	if constexpr (_is_memory) {
+		const auto available = _istream.data().size() - _data_position;
+		const auto byte_size = is_sized ? std::min<size_t>(chunk_size, available) : available;
+		_streaminfo.sample_count = byte_size / frame_byte_size;
+		_remaining_count = _streaminfo.sample_count;
+	} else {
+		_streaminfo.sample_count = is_sized ? chunk_size / frame_byte_size : 0;
+		_remaining_count = is_sized ? _streaminfo.sample_count : ~uint64_t{0};
+		_pcm_buffer.resize(BUFFER_SIZE * frame_byte_size);
+	}
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE>
+inline const std::byte *decoder<INPUT_STREAM, BUFFER_SIZE>::_read(size_t &count)
+{   // O(N)
+	const auto byte_size = count * _frame_byte_size();
+
+	if constexpr (_is_memory) {
+		const auto *res = _istream.data().data() + _istream.position();
+		_istream.seek(_istream.position() + byte_size);
+
+		return res;
+	} else {
+		size_t byte_count = 0;
+		for (; (byte_count < byte_size) && !_istream.eos(); ++byte_count)
+			_pcm_buffer[byte_count] = (std::byte)_istream.get_byte();
+
+		if ((byte_count < byte_size) && (_remaining_count != ~uint64_t{0}))
+			throw basics::error{"%s: (protocol error) unexpected end of stream", _decoder_name};
+		count = byte_count / _frame_byte_size();
+
+		return _pcm_buffer.data();
+	}
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE>
+inline uint32_t decoder<INPUT_STREAM, BUFFER_SIZE>::_get_uint(uint8_t byte_count)
+{   // little-endian
+	uint32_t res = 0;
+	for (uint8_t i = 0; i < byte_count; ++i) {
+		if (_istream.eos())
+			throw basics::error{"%s: (protocol error) unexpected end of stream", _decoder_name};
+		res |= (uint32_t)_istream.get_byte() << (8 * i);
+	}
+
+	return res;
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE>
+inline void decoder<INPUT_STREAM, BUFFER_SIZE>::_skip(size_t byte_count)
+{
+	if constexpr (_is_memory) {
+		if (_istream.data().size() - _istream.position() < byte_count)
+			throw basics::error{"%s: (protocol error) unexpected end of stream", _decoder_name};
+		_istream.seek(_istream.position() + byte_count);
+	} else {
+		for (; byte_count > 0; --byte_count)
+			_get_uint(1);
+	}
+}
+
+
+template<typename INPUT_STREAM, size_t BUFFER_SIZE>
+inline size_t decoder<INPUT_STREAM, BUFFER_SIZE>::_frame_byte_size() const
+{
+	return (size_t)_streaminfo.channel_count * (_container_bit_size / 8);
+}
+
+
 } // namespace wave
 } // namespace audio
 
@@ -0,0 +1,120 @@
+/* Copyright (C) 2024  Bogdan-Gabriel Alecu  (GameInstance.com)
+ *
+ * audio - C++ audio codecs.
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <vector>
+#include "buffer.hh"
+
+
+namespace audio {
+
+
+class _block_pool {  // freed blocks of one thread, most recent last
+public:
+	_block_pool();
+	~_block_pool();
+
+	void *take(size_t byte_size, size_t alignment);
+	bool put(void *data, size_t byte_size, size_t alignment);
+	void trim();
+
+private:
+	struct _block_type {
+		void *data;
+		size_t byte_size;
+		size_t alignment;
+	};
+
+	std::vector<_block_type> _blocks;
+	bool _is_open;  // blocks freed by thread_local objects destroyed after the pool go to the heap
+
+	static constexpr size_t _max_block_count = 16;
+};
+
+
+static thread_local _block_pool _pool;
+
+
+_block_pool::_block_pool()
+	: _blocks{}, _is_open{true}
+{
+	_blocks.reserve(_max_block_count);
+}
+
+
+_block_pool::~_block_pool()
+{
+	trim();
+	_is_open = false;
+}
+
+
+void *_block_pool::take(size_t byte_size, size_t alignment)
+{   // O(pooled block count)
+	for (size_t i = _blocks.size(); i > 0; --i) {
+		const auto block = _blocks[i - 1];
+		if ((block.byte_size == byte_size) && (block.alignment == alignment)) {
+			_blocks.erase(_blocks.begin() + (i - 1));
+
+			return block.data;
+		}
+	}
+
+	return nullptr;
+}
+
+
+bool _block_pool::put(void *data, size_t byte_size, size_t alignment)
+{
+	if (!_is_open || (_blocks.size() == _max_block_count))
+		return false;
+
+	_blocks.push_back({data, byte_size, alignment});
+
+	return true;
+}
+
+
+void _block_pool::trim()
+{
+	for (const auto &block: _blocks)
+		::operator delete(block.data, std::align_val_t{block.alignment});
+	_blocks.clear();
+}
+
+
+void *_pool_allocate(size_t byte_size, size_t alignment)
+{
+	if (auto *res = _pool.take(byte_size, alignment))
+		return res;
+
+	return ::operator new(byte_size, std::align_val_t{alignment});
+}
+
+
+void _pool_deallocate(void *data, size_t byte_size, size_t alignment)
+{
+	if (!_pool.put(data, byte_size, alignment))
+		::operator delete(data, std::align_val_t{alignment});
+}
+
+
+void trim_buffer_pool()
+{
+	_pool.trim();
+}
+
+
+} // namespace audio
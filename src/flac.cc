@@ -14,4 +14,562 @@
  * If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <span>
+#include <string_view>
+#include <vector>
 #include "flac.hh"
+
+
+namespace audio {
+namespace flac {
+
+
+static constexpr uint8_t _max_partition_order = 8;
+static constexpr uint8_t _max_rice_parameter = 30;  // PARTITIONED_RICE2; PARTITIONED_RICE: 14
+static constexpr uint32_t _sample_rates[12] = {0, 88200, 176400, 192000, 8000, 16000, 22050, 24000,
+																		32000, 44100, 48000, 96000};
+static constexpr uint8_t _sample_bit_sizes[8] = {0, 8, 12, 0, 16, 20, 24, 32};
+
+struct _encoder_work {  // per worker thread, reused across frames
+	std::vector<int64_t> signals[4];  // channels, then side and mid of stereo frames
+	std::vector<int64_t> residual;
+	std::vector<double> window;
+	bit::output subframes[4];
+	bit::output candidate;
+	bit::output frame;
+};
+
+
+static uint8_t _block_size_code(uint16_t size)
+{
+	if (size == 192)
+		return 1;
+	for (uint8_t code = 2; code < 6; ++code)
+		if (size == 144 << code)
+			return code;
+	for (uint8_t code = 8; code < 16; ++code)
+		if (size == 256 << (code - 8))
+			return code;
+
+	return (size <= 256) ? 6 : 7;  // 8-bit or 16-bit size - 1 at the end of the header
+}
+
+
+static uint8_t _code(const auto &table, uint32_t value)
+{   // index of value in table, 0 (read from STREAMINFO) if none
+	for (uint8_t code = 1; code < std::size(table); ++code)
+		if (table[code] == value)
+			return code;
+
+	return 0;
+}
+
+
+static void _put_utf8(bit::output &ostream, uint64_t value)
+{
+	if (value < 0x80)
+		return ostream.put_uint(value, 8);
+
+	uint8_t byte_count = 2;  // holding 5 * byte_count + 1 bits
+	while ((value >> (5 * byte_count + 1)) != 0)
+		++byte_count;
+
+	ostream.put_uint(((0xff << (8 - byte_count)) & 0xff) | (value >> (6 * (byte_count - 1))), 8);
+	for (auto i = (int8_t)(byte_count - 2); i >= 0; --i)
+		ostream.put_uint(0x80 | ((value >> (6 * i)) & 0x3f), 8);
+}
+
+
+static uint8_t _rice_parameter(uint64_t sum, size_t count, uint64_t &bit_size)
+{   // parameter minimizing the estimated size of count codes summing to sum
+	if (count == 0) {
+		bit_size = 0;
+
+		return 0;
+	}
+
+	const auto mean = sum / count;
+	const auto mean_bit_size = (mean > 0) ? (int)std::bit_width(mean) - 1 : 0;
+	const auto guess = (uint8_t)std::min<int>(mean_bit_size, _max_rice_parameter);
+	uint8_t res{0};
+	bit_size = ~uint64_t{0};
+	for (auto parameter = (uint8_t)std::max(guess - 1, 0); parameter <= std::min<int>(guess + 1,
+																_max_rice_parameter); ++parameter) {
+		const auto size = count * (parameter + 1) + (sum >> parameter);
+		if (size < bit_size) {
+			bit_size = size;
+			res = parameter;
+		}
+	}
+
+	return res;
+}
+
+
+static bool _encode_residual(bit::output &ostream, const int64_t *residual, uint16_t size,
+																					uint8_t order)
+{   // O(N); false if a residual doesn't fit 32 bits
+	uint8_t max_partition_order{0};
+	while ((max_partition_order < _max_partition_order) &&
+			(size % (2u << max_partition_order) == 0) &&
+			((size >> (max_partition_order + 1)) > order))
+		++max_partition_order;
+
+	// zig-zag sums of the finest partitions, merged pairwise for every coarser partition order
+	std::array<uint64_t, 1 << _max_partition_order> sums{};
+	const auto finest_size = (uint16_t)(size >> max_partition_order);
+	for (size_t i = order; i < size; ++i) {
+		if ((residual[i] > INT32_MAX) || (residual[i] < INT32_MIN))
+			return false;
+		sums[i / finest_size] += ((uint64_t)residual[i] << 1) ^ (uint64_t)(residual[i] >> 63);
+	}
+
+	std::array<uint8_t, 1 << _max_partition_order> parameters, best_parameters;
+	auto best_bit_size = ~uint64_t{0};
+	uint8_t best_partition_order{0};
+	for (auto partition_order = (int8_t)max_partition_order; partition_order >= 0;
+																				--partition_order) {
+		const auto partition_count = (size_t)1 << partition_order;
+		const auto partition_size = (size_t)(size >> partition_order);
+		uint64_t bit_size{0};
+		uint8_t max_parameter{0};
+		for (size_t i = 0; i < partition_count; ++i) {
+			uint64_t partition_bit_size;
+			const auto count = partition_size - ((i == 0) ? order : 0);
+			parameters[i] = _rice_parameter(sums[i], count, partition_bit_size);
+			bit_size += partition_bit_size;
+			max_parameter = std::max(max_parameter, parameters[i]);
+		}
+		bit_size += partition_count * ((max_parameter > 14) ? 5 : 4);
+		if (bit_size < best_bit_size) {
+			best_bit_size = bit_size;
+			best_partition_order = partition_order;
+			std::copy_n(parameters.begin(), partition_count, best_parameters.begin());
+		}
+
+		for (size_t i = 0; i < partition_count / 2; ++i)
+			sums[i] = sums[2 * i] + sums[2 * i + 1];
+	}
+
+	const auto partition_count = (size_t)1 << best_partition_order;
+	const auto partition_size = (size_t)(size >> best_partition_order);
+	const auto *parameters_data = best_parameters.data();
+	const auto is_rice2 = std::any_of(parameters_data, parameters_data + partition_count,
+												[](uint8_t parameter) { return parameter > 14; });
+	ostream.put_uint(is_rice2 ? 1 : 0, 2);
+	ostream.put_uint(best_partition_order, 4);
+	for (size_t i = 0; i < partition_count; ++i) {
+		const auto start = i * partition_size + ((i == 0) ? order : 0);
+		ostream.put_uint(best_parameters[i], is_rice2 ? 5 : 4);
+		const auto end = (i + 1) * partition_size;
+		ostream.put_rice_ints(residual + start, end - start, best_parameters[i]);
+	}
+
+	return true;
+}
+
+
+static uint8_t _fixed_order(const int64_t *samples, uint16_t size)
+{   // O(N); the order with the smallest absolute residual sum
+	if (size <= lpc::max_fixed_order)
+		return 0;
+
+	// errors[k] is the order k residual, i.e. the k-th difference of the signal
+	int64_t errors[lpc::max_fixed_order + 1];
+	int64_t last[lpc::max_fixed_order];  // previous differences of orders 0-3
+	last[0] = samples[3];
+	last[1] = samples[3] - samples[2];
+	last[2] = last[1] - (samples[2] - samples[1]);
+	last[3] = last[2] - ((samples[2] - samples[1]) - (samples[1] - samples[0]));
+
+	uint64_t sums[lpc::max_fixed_order + 1]{};
+	for (size_t i = lpc::max_fixed_order; i < size; ++i) {
+		errors[0] = samples[i];
+		for (uint8_t k = 1; k <= lpc::max_fixed_order; ++k)
+			errors[k] = errors[k - 1] - last[k - 1];
+		for (uint8_t k = 0; k < lpc::max_fixed_order; ++k)
+			last[k] = errors[k];
+		for (uint8_t k = 0; k <= lpc::max_fixed_order; ++k)
+			sums[k] += (uint64_t)std::abs(errors[k]);
+	}
+
+	return (uint8_t)(std::min_element(sums, sums + lpc::max_fixed_order + 1) - sums);
+}
+
+
+static uint8_t _lpc_precision(uint8_t sample_bit_size, uint16_t size)
+{   // coefficient bits, fewer for short blocks where they weigh more
+	const auto precision = (size <= 192) ? 7 : (size <= 384) ? 8 : (size <= 576) ? 9 :
+					(size <= 1152) ? 10 : (size <= 2304) ? 11 : (size <= 4608) ? 12 : 13;
+
+	return (uint8_t)((sample_bit_size <= 16) ? precision : std::min(precision + 2, 15));
+}
+
+
+static void _put_subframe_header(bit::output &ostream, uint8_t type)
+{
+	ostream.put_uint(type << 1, 8);  // zero padding, type, no wasted bits
+}
+
+
+static void _encode_subframe(bit::output &ostream, const int64_t *samples, uint16_t size,
+							uint8_t sample_bit_size, uint8_t max_lpc_order, _encoder_work &work)
+{   // O(N*max_lpc_order); the cheapest of CONSTANT, FIXED, LPC and VERBATIM
+	ostream.clear();
+	const auto is_constant = [samples](int64_t sample) { return sample == samples[0]; };
+	if (std::all_of(samples + 1, samples + size, is_constant)) {
+		_put_subframe_header(ostream, 0);  // SUBFRAME_CONSTANT
+		ostream.put_int(samples[0], sample_bit_size);
+
+		return;
+	}
+
+	auto best_bit_size = 8 + (size_t)size * sample_bit_size;  // SUBFRAME_VERBATIM
+	auto &candidate = work.candidate;
+	auto *residual = work.residual.data();
+	const auto try_candidate = [&]() {
+		if (candidate.bit_size() >= best_bit_size)
+			return;
+
+		best_bit_size = candidate.bit_size();
+		std::swap(ostream, candidate);
+	};
+
+	// SUBFRAME_FIXED
+	const auto fixed_order = _fixed_order(samples, size);
+	lpc::residual_fixed(samples, size, fixed_order, residual);
+	candidate.clear();
+	_put_subframe_header(candidate, 8 + fixed_order);
+	for (uint8_t i = 0; i < fixed_order; ++i)
+		candidate.put_int(samples[i], sample_bit_size);
+	if (_encode_residual(candidate, residual, size, fixed_order))
+		try_candidate();
+
+	// SUBFRAME_LPC
+	const auto max_order = (uint8_t)std::min<size_t>(max_lpc_order, size - 1u);
+	double autocorrelation[lpc::max_order + 1];
+	if (max_order > 0)
+		lpc::autocorrelation(samples, work.window.data(), size, max_order + 1, autocorrelation);
+	if ((max_order > 0) && (autocorrelation[0] > 0.0)) {
+		double coefficients[lpc::max_order][lpc::max_order];
+		double errors[lpc::max_order];
+		const auto order_count = lpc::levinson_durbin(autocorrelation, max_order, coefficients,
+																							errors);
+
+		// estimated bits: Laplacian residuals of the predicted variance, coefficients and warm-up
+		const auto precision = _lpc_precision(sample_bit_size, size);
+		uint8_t order{1};
+		auto best_estimate = HUGE_VAL;
+		for (uint8_t i = 1; i <= order_count; ++i) {
+			const auto error = errors[i - 1] * 0.5 / size;
+			const auto bits_per_sample =
+										(error > 0.0) ? std::max(0.5 * std::log2(error), 0.0) : 0.0;
+			const auto estimate = bits_per_sample * (size - i) + i * (precision + sample_bit_size);
+			if (estimate < best_estimate) {
+				best_estimate = estimate;
+				order = i;
+			}
+		}
+
+		int32_t quantized[lpc::max_order];
+		const auto shift = lpc::quantize(coefficients[order - 1], order, precision, quantized);
+		if (shift >= 0) {
+			lpc::residual(samples, size, quantized, order, shift, residual);
+			candidate.clear();
+			_put_subframe_header(candidate, 32 + order - 1);
+			for (uint8_t i = 0; i < order; ++i)
+				candidate.put_int(samples[i], sample_bit_size);
+			candidate.put_uint(precision - 1, 4);
+			candidate.put_int(shift, 5);
+			for (uint8_t i = 0; i < order; ++i)
+				candidate.put_int(quantized[i], precision);
+			if (_encode_residual(candidate, residual, size, order))
+				try_candidate();
+		}
+	}
+
+	if (ostream.bit_size() > 0)
+		return;
+
+	_put_subframe_header(ostream, 1);  // SUBFRAME_VERBATIM
+	for (uint16_t i = 0; i < size; ++i)
+		ostream.put_int(samples[i], sample_bit_size);
+}
+
+
+std::vector<std::byte> encode_frame(const sample_view<const int32_t> &planar,
+									const streaminfo_type &streaminfo, uint64_t frame_number,
+																			uint8_t max_lpc_order)
+{   // O(N*channel_count*max_lpc_order)
+	static thread_local _encoder_work work;
+
+	const auto size = (uint16_t)planar.size();
+	const auto channel_count = planar.channel_count();
+	const auto sample_bit_size = streaminfo.sample_bit_size;
+	for (auto &signal: work.signals)
+		signal.resize(size);
+	work.residual.resize(size);
+	if (work.window.size() != size) {
+		work.window.resize(size);
+		lpc::tukey_window(work.window.data(), size);
+	}
+
+	// SUBFRAME+: stereo frames pick the cheapest pair among left, right, side and mid
+	uint8_t channel_assignment = channel_count - 1;
+	const bit::output *subframes[max_channel_count];
+	if (channel_count == 2) {
+		auto *left = work.signals[0].data();
+		auto *right = work.signals[1].data();
+		auto *side = work.signals[2].data();
+		auto *mid = work.signals[3].data();
+		for (uint16_t i = 0; i < size; ++i) {
+			left[i] = planar[0][i];
+			right[i] = planar[1][i];
+			side[i] = left[i] - right[i];
+			mid[i] = (left[i] + right[i]) >> 1;
+		}
+
+		for (uint8_t i = 0; i < 4; ++i)
+			_encode_subframe(work.subframes[i], work.signals[i].data(), size,
+										sample_bit_size + ((i == 2) ? 1 : 0), max_lpc_order, work);
+
+		// independent, left-side, side-right, mid-side
+		static constexpr uint8_t pairs[4][2] = {{0, 1}, {0, 2}, {2, 1}, {3, 2}};
+		auto best_bit_size = ~size_t{0};
+		for (uint8_t i = 0; i < 4; ++i) {
+			const auto bit_size = work.subframes[pairs[i][0]].bit_size() +
+															work.subframes[pairs[i][1]].bit_size();
+			if (bit_size < best_bit_size) {
+				best_bit_size = bit_size;
+				channel_assignment = (i == 0) ? 1 : 7 + i;
+				subframes[0] = &work.subframes[pairs[i][0]];
+				subframes[1] = &work.subframes[pairs[i][1]];
+			}
+		}
+	}
+
+	// FRAME_HEADER
+	auto &ostream = work.frame;
+	ostream.clear();
+	const auto block_size_code = _block_size_code(size);
+	ostream.put_uint(0b11111111111110, 14);
+	ostream.put_uint(0, 1);  // reserved
+	ostream.put_uint(0, 1);  // fixed block size: frame numbers
+	ostream.put_uint(block_size_code, 4);
+	ostream.put_uint(_code(_sample_rates, streaminfo.sample_rate), 4);
+	ostream.put_uint(channel_assignment, 4);
+	ostream.put_uint(_code(_sample_bit_sizes, sample_bit_size), 3);
+	ostream.put_uint(0, 1);  // reserved
+	_put_utf8(ostream, frame_number);
+	if (block_size_code == 6)
+		ostream.put_uint(size - 1, 8);
+	else if (block_size_code == 7)
+		ostream.put_uint(size - 1, 16);
+	ostream.align();
+	ostream.put_uint(crc::crc8(ostream.data().data(), ostream.data().size()), 8);
+
+	if (channel_count == 2) {
+		ostream.put_bits(*subframes[0]);
+		ostream.put_bits(*subframes[1]);
+	} else {
+		for (uint8_t channel_idx = 0; channel_idx < channel_count; ++channel_idx) {
+			auto *signal = work.signals[0].data();
+			std::copy_n(planar[channel_idx].begin(), size, signal);
+			_encode_subframe(work.subframes[0], signal, size, sample_bit_size, max_lpc_order, work);
+			ostream.put_bits(work.subframes[0]);
+		}
+	}
+
+	// FRAME_FOOTER
+	ostream.align();
+	ostream.put_uint(crc::crc16(ostream.data().data(), ostream.data().size()), 16);
+	ostream.align();
+
+	return {ostream.data().begin(), ostream.data().end()};
+}
+
+
+frame_index::frame_index()
+	: _storage{}, _blob{}, _size{0}
+{
+}
+
+
+frame_index frame_index::load(std::span<const std::byte> blob)
+{   // O(1)
+	if ((blob.size() < _index_header_size) ||
+			!std::equal(_index_magic, _index_magic + sizeof(_index_magic), blob.data()))
+		throw basics::error{"%s: (protocol error) unexpected marker", _index_name};
+
+	const auto size = _get_le(blob.data() + sizeof(_index_magic), 8);
+	if ((blob.size() - _index_header_size) / _index_frame_size != size ||
+			(blob.size() - _index_header_size) % _index_frame_size != 0)
+		throw basics::error{"%s: (protocol error) unexpected size (%zu bytes for %lu frames)",
+																	_index_name, blob.size(), size};
+
+	auto res = frame_index{};
+	res._blob = blob;
+	res._size = size;
+
+	return res;
+}
+
+
+
+static uint64_t _get_be(const std::byte *data, uint8_t byte_count)
+{
+	uint64_t res{0};
+	for (uint8_t i = 0; i < byte_count; ++i)
+		res = (res << 8) | (uint8_t)data[i];
+
+	return res;
+}
+
+
+probe_type probe(std::span<const std::byte> data)
+{   // O(metadata block count)
+	if ((data.size() < 4) || (_get_be(data.data(), 4) != 0x664c6143))
+		throw basics::error{"%s: (protocol error) unexpected marker", _decoder_name};
+	if (data.size() < 4 + 4 + 34)
+		throw basics::error{"%s: (protocol error) missing STREAMINFO", _decoder_name};
+
+	auto res = probe_type{};
+	for (size_t offset = 4; offset + 4 <= data.size();) {
+		// METADATA_BLOCK_HEADER <32>
+		const auto header = (uint32_t)_get_be(data.data() + offset, 4);
+		const auto is_last = (header >> 31) == 1;
+		const auto metadata_type_id = (header >> 24) & 0x7f;
+		const auto block = metadata_block_type{offset + 4, header & 0xffffff};
+
+		if (offset == 4) {  // STREAMINFO, mandatory first
+			if ((metadata_type_id != 0) || (block.size < 34) || (block.offset + 34 > data.size()))
+				throw basics::error{"%s: (protocol error) missing STREAMINFO", _decoder_name};
+
+			const auto *streaminfo = data.data() + block.offset;
+			// rate <20>, channels <3>, bits <5>, count <36>
+			const auto fields = _get_be(streaminfo + 10, 8);
+			res.streaminfo.min_block_size  = _get_be(streaminfo, 2);
+			res.streaminfo.max_block_size  = _get_be(streaminfo + 2, 2);
+			res.streaminfo.min_frame_size  = _get_be(streaminfo + 4, 3);
+			res.streaminfo.max_frame_size  = _get_be(streaminfo + 7, 3);
+			res.streaminfo.sample_rate     = fields >> 44;
+			res.streaminfo.channel_count   = ((fields >> 41) & 0x7) + 1;
+			res.streaminfo.sample_bit_size = ((fields >> 36) & 0x1f) + 1;
+			res.streaminfo.sample_count    = fields & 0xfffffffff;
+			auto &md5_signature = res.streaminfo.md5_signature;
+			std::memcpy(md5_signature.data(), streaminfo + 18, md5_signature.size());
+		} else if (metadata_type_id == 3) {  // SEEKTABLE
+			res.seektable = block;
+		} else if (metadata_type_id == 4) {  // VORBIS_COMMENT
+			res.vorbis_comment = block;
+		} else if ((metadata_type_id == 6) && (res.picture.offset == 0)) {  // PICTURE
+			res.picture = block;
+		}
+
+		offset = block.offset + block.size;
+		if (is_last) {
+			res.audio_offset = offset;
+			break;
+		}
+	}
+
+	return res;
+}
+
+
+static std::span<const std::byte> _get_bytes(std::span<const std::byte> data, size_t &offset,
+																				size_t byte_count)
+{
+	if (data.size() - offset < byte_count)
+		throw basics::error{"%s: (protocol error) truncated metadata block", _decoder_name};
+
+	const auto res = data.subspan(offset, byte_count);
+	offset += byte_count;
+
+	return res;
+}
+
+
+static uint32_t _get_le32(std::span<const std::byte> data, size_t &offset)
+{
+	const auto *bytes = _get_bytes(data, offset, 4).data();
+
+	return (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 |
+																		(uint32_t)bytes[3] << 24;
+}
+
+
+static uint32_t _get_be32(std::span<const std::byte> data, size_t &offset)
+{
+	return (uint32_t)_get_be(_get_bytes(data, offset, 4).data(), 4);
+}
+
+
+static std::string_view _get_string(std::span<const std::byte> bytes)
+{
+	return {(const char *)bytes.data(), bytes.size()};
+}
+
+
+vorbis_comment_type decode_vorbis_comment(std::span<const std::byte> data)
+{   // O(comment count); lengths are little-endian, as in Vorbis
+	size_t offset{0};
+	auto res = vorbis_comment_type{};
+	res.vendor = _get_string(_get_bytes(data, offset, _get_le32(data, offset)));
+
+	const auto comment_count = _get_le32(data, offset);
+	if (comment_count > (data.size() - offset) / 4)
+		throw basics::error{"%s: (protocol error) truncated metadata block", _decoder_name};
+
+	res.comments.reserve(comment_count);
+	for (uint32_t i = 0; i < comment_count; ++i)
+		res.comments.push_back(_get_string(_get_bytes(data, offset, _get_le32(data, offset))));
+
+	return res;
+}
+
+
+picture_type decode_picture(std::span<const std::byte> data)
+{
+	size_t offset{0};
+	auto res = picture_type{};
+	res.type        = _get_be32(data, offset);
+	res.mime_type   = _get_string(_get_bytes(data, offset, _get_be32(data, offset)));
+	res.description = _get_string(_get_bytes(data, offset, _get_be32(data, offset)));
+	res.width       = _get_be32(data, offset);
+	res.height      = _get_be32(data, offset);
+	res.color_depth = _get_be32(data, offset);
+	res.color_count = _get_be32(data, offset);
+	res.data        = _get_bytes(data, offset, _get_be32(data, offset));
+
+	return res;
+}
+
+
+decoder_counters::decoder_counters()
+	: _cycles{}, _subframe_counts{}, _frame_count{0}, _sample_count{0}, _partition_count{0},
+	  _escape_count{0}
+{
+}
+
+
+void decoder_counters::reset()
+{
+	for (auto &counter: _cycles)
+		counter.store(0, std::memory_order_relaxed);
+	for (auto &counter: _subframe_counts)
+		counter.store(0, std::memory_order_relaxed);
+	_frame_count.store(0, std::memory_order_relaxed);
+	_sample_count.store(0, std::memory_order_relaxed);
+	_partition_count.store(0, std::memory_order_relaxed);
+	_escape_count.store(0, std::memory_order_relaxed);
+}
+
+
+} // namespace flac
+} // namespace audio
@@ -0,0 +1,302 @@
+/* Copyright (C) 2024  Bogdan-Gabriel Alecu  (GameInstance.com)
+ *
+ * audio - C++ audio codecs.
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+#include <vector>
+#include "lpc.hh"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+
+namespace audio {
+namespace lpc {
+
+
+#if defined(__x86_64__) || defined(__aarch64__)
+
+template<uint8_t LANE_COUNT>
+static uint8_t _reverse_taps(int32_t *taps, const int32_t *coefficients, uint8_t order)
+{  // returns the padded order: taps[k] multiplies samples[i - padded_order + k]
+	const auto padded_order = (uint8_t)((order + LANE_COUNT - 1) / LANE_COUNT * LANE_COUNT);
+	for (uint8_t k = 0; k < padded_order - order; ++k)
+		taps[k] = 0;
+	for (uint8_t j = 0; j < order; ++j)
+		taps[padded_order - 1 - j] = coefficients[j];
+
+	return padded_order;
+}
+
+
+template<typename T>
+static void _restore_head(T *samples, size_t size, const int32_t *coefficients, uint8_t order,
+																			uint8_t shift, size_t end)
+{  // scalar restore of the samples that precede a full vector window
+	for (size_t i = order; (i < end) && (i < size); ++i) {
+		int64_t sum{0};
+		for (uint8_t j = 0; j < order; ++j)
+			sum += (int64_t)coefficients[j] * samples[i - 1 - j];
+
+		samples[i] += (T)(sum >> shift);
+	}
+}
+
+#endif
+
+
+#if defined(__x86_64__)
+
+template<typename T>
+__attribute__((target("avx2")))
+static inline __m256i _load_avx2(const T *values)
+{  // 4 samples, sign-extended to 64-bit lanes
+	if constexpr (sizeof(T) == sizeof(int32_t))
+		return _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)values));
+	else
+		return _mm256_loadu_si256((const __m256i *)values);
+}
+
+
+template<typename T>
+__attribute__((target("avx2")))
+static void _restore_avx2(T *samples, size_t size, const int32_t *coefficients, uint8_t order,
+																						uint8_t shift)
+{   // O(N*order/4)
+	alignas(32) int32_t taps[max_order];
+	const auto padded_order = _reverse_taps<4>(taps, coefficients, order);
+	_restore_head(samples, size, coefficients, order, shift, padded_order);
+	if (size <= padded_order)
+		return;
+
+	// the 4 newest samples stay in registers; the vector loads only touch samples stored at least
+	// 4 iterations earlier, which keeps them clear of store-to-load forwarding stalls
+	const auto chunk_count = (uint8_t)(padded_order / 4 - 1);
+	__m256i lanes[max_order / 4];
+	for (uint8_t k = 0; k < chunk_count; ++k)  // one 32-bit tap in the low half of each lane
+		lanes[k] = _mm256_cvtepi32_epi64(_mm_load_si128((const __m128i *)&taps[4 * k]));
+	const int64_t newest_taps[4] = {taps[padded_order - 1], taps[padded_order - 2],
+											taps[padded_order - 3], taps[padded_order - 4]};
+
+	auto history = _load_avx2(samples + padded_order - 4);
+	alignas(32) int64_t newest[4];
+	_mm256_store_si256((__m256i *)newest, history);
+	auto h1 = newest[3], h2 = newest[2], h3 = newest[1], h4 = newest[0];
+
+	for (auto i = (size_t)padded_order; i < size; ++i) {
+		const auto *window = samples + i - padded_order;
+		auto sum = _mm256_setzero_si256();
+		for (uint8_t k = 0; k < chunk_count; ++k) {
+			const auto values = _load_avx2(window + 4 * k);
+			sum = _mm256_add_epi64(sum, _mm256_mul_epi32(values, lanes[k]));
+		}
+		const auto half = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+		const auto total = _mm_cvtsi128_si64(half) + _mm_extract_epi64(half, 1)
+							+ newest_taps[0] * h1 + newest_taps[1] * h2
+							+ newest_taps[2] * h3 + newest_taps[3] * h4;
+
+		h4 = h3;
+		h3 = h2;
+		h2 = h1;
+		samples[i] += (T)(total >> shift);
+		h1 = samples[i];
+	}
+}
+
+
+template<typename T>
+static vector_kernel_type<T> _select_vector_kernel()
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return _restore_avx2<T>;
+
+	return nullptr;
+}
+
+#elif defined(__aarch64__)
+
+template<typename T>
+static inline int32x2_t _load_neon(const T *values)
+{  // 2 samples, narrowed to 32 bits
+	if constexpr (sizeof(T) == sizeof(int32_t))
+		return vld1_s32(values);
+	else
+		return vmovn_s64(vld1q_s64(values));
+}
+
+
+template<typename T>
+static void _restore_neon(T *samples, size_t size, const int32_t *coefficients, uint8_t order,
+																						uint8_t shift)
+{   // O(N*order/2)
+	alignas(16) int32_t taps[max_order];
+	const auto padded_order = _reverse_taps<2>(taps, coefficients, order);
+	_restore_head(samples, size, coefficients, order, shift, padded_order);
+
+	for (size_t i = padded_order; i < size; ++i) {
+		const auto *window = samples + i - padded_order;
+		auto sum = vdupq_n_s64(0);
+		for (uint8_t k = 0; k < padded_order; k += 2)
+			sum = vmlal_s32(sum, _load_neon(window + k), vld1_s32(&taps[k]));
+
+		samples[i] += (T)(vaddvq_s64(sum) >> shift);
+	}
+}
+
+
+template<typename T>
+static vector_kernel_type<T> _select_vector_kernel()
+{
+	return _restore_neon<T>;  // NEON is mandatory on AArch64
+}
+
+#else
+
+template<typename T>
+static vector_kernel_type<T> _select_vector_kernel()
+{
+	return nullptr;
+}
+
+#endif
+
+
+const vector_kernel_type<int32_t> vector_kernel_32 = _select_vector_kernel<int32_t>();
+const vector_kernel_type<int64_t> vector_kernel_64 = _select_vector_kernel<int64_t>();
+
+
+void tukey_window(double *window, size_t size)
+{   // O(N); cosine tapers over a quarter of the window at each end
+	const auto taper_size = size / 4;
+	for (size_t i = 0; i < size; ++i)
+		window[i] = 1.0;
+	for (size_t i = 0; i < taper_size; ++i) {
+		const auto value = 0.5 - 0.5 * std::cos(std::numbers::pi * (double)i / (double)taper_size);
+		window[i] = value;
+		window[size - 1 - i] = value;
+	}
+}
+
+
+void autocorrelation(const int64_t *samples, const double *window, size_t size, uint8_t lag_count,
+																					double *res)
+{   // O(N*lag_count)
+	std::vector<double> windowed(size);
+	for (size_t i = 0; i < size; ++i)
+		windowed[i] = (double)samples[i] * window[i];
+
+	for (uint8_t lag = 0; lag < lag_count; ++lag) {
+		double sum{0};
+		for (size_t i = lag; i < size; ++i)
+			sum += windowed[i] * windowed[i - lag];
+		res[lag] = sum;
+	}
+}
+
+
+uint8_t levinson_durbin(const double *autocorrelation, uint8_t order, double coefficients[][max_order],
+																					double *errors)
+{   // O(order^2); returns the highest order solved, lower when the error vanishes first
+	double lpc[max_order];
+	auto error = autocorrelation[0];
+	for (uint8_t i = 0; i < order; ++i) {
+		auto reflection = -autocorrelation[i + 1];
+		for (uint8_t j = 0; j < i; ++j)
+			reflection -= lpc[j] * autocorrelation[i - j];
+		reflection /= error;
+
+		lpc[i] = reflection;
+		for (uint8_t j = 0; j < i / 2; ++j) {
+			const auto value = lpc[j];
+			lpc[j] += reflection * lpc[i - 1 - j];
+			lpc[i - 1 - j] += reflection * value;
+		}
+		if (i % 2 == 1)
+			lpc[i / 2] += lpc[i / 2] * reflection;
+
+		error *= 1.0 - reflection * reflection;
+		for (uint8_t j = 0; j <= i; ++j)
+			coefficients[i][j] = -lpc[j];  // predicting samples[n] from samples[n - 1 - j]
+		errors[i] = error;
+		if (error <= 0.0)
+			return i + 1;
+	}
+
+	return order;
+}
+
+
+int8_t quantize(const double *coefficients, uint8_t order, uint8_t precision, int32_t *res)
+{   // O(order); returns the shift, -1 if the coefficients don't fit precision bits
+	static constexpr int8_t max_shift = 15;  // signed 5-bit field
+
+	double max_coefficient{0};
+	for (uint8_t i = 0; i < order; ++i)
+		max_coefficient = std::max(max_coefficient, std::fabs(coefficients[i]));
+	if (max_coefficient <= 0.0)
+		return -1;
+
+	int exponent;
+	std::frexp(max_coefficient, &exponent);
+	const auto shift = (int8_t)std::min<int>(precision - 1 - exponent, max_shift);
+	if (shift < 0)
+		return -1;
+
+	// rounding with error feedback, so that rounding errors don't accumulate along the taps
+	const auto max_value = (1 << (precision - 1)) - 1;
+	const auto min_value = -(1 << (precision - 1));
+	double error{0};
+	for (uint8_t i = 0; i < order; ++i) {
+		error += coefficients[i] * (double)(1 << shift);
+		const auto value = (int32_t)std::clamp<long>(std::lround(error), min_value, max_value);
+		error -= value;
+		res[i] = value;
+	}
+
+	return shift;
+}
+
+
+void residual_fixed(const int64_t *samples, size_t size, uint8_t order, int64_t *res)
+{   // O(N)
+	for (size_t i = order; i < size; ++i) {
+		int64_t prediction{0};
+		for (uint8_t j = 0; j < order; ++j)
+			prediction += _fixed_coefficients[order][j] * samples[i - 1 - j];
+		res[i] = samples[i] - prediction;
+	}
+}
+
+
+void residual(const int64_t *samples, size_t size, const int32_t *coefficients, uint8_t order,
+																			uint8_t shift, int64_t *res)
+{   // O(N*order)
+	for (size_t i = order; i < size; ++i) {
+		int64_t sum{0};
+		for (uint8_t j = 0; j < order; ++j)
+			sum += (int64_t)coefficients[j] * samples[i - 1 - j];
+		res[i] = samples[i] - (sum >> shift);
+	}
+}
+
+
+} // namespace lpc
+} // namespace audio
@@ -0,0 +1,165 @@
+/* Copyright (C) 2024  Bogdan-Gabriel Alecu  (GameInstance.com)
+ *
+ * audio - C++ audio codecs.
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <bit>
+#include <cstring>
+#include "md5.hh"
+
+
+namespace audio {
+namespace md5 {
+
+
+// floor(abs(sin(i + 1)) * 2^32), as tabulated in RFC 1321
+static constexpr uint32_t _sines[64] = {
+	0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+	0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+	0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+	0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+	0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+	0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+	0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+	0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+};
+
+static constexpr uint8_t _shifts[4][4] = {{7, 12, 17, 22}, {5, 9, 14, 20}, {4, 11, 16, 23},
+																					{6, 10, 15, 21}};
+static constexpr std::array<uint32_t, 4> _initial_state = {0x67452301, 0xefcdab89, 0x98badcfe,
+																							0x10325476};
+
+
+context::context()
+	: _state{_initial_state}, _size{0}, _buffer{}
+{
+}
+
+
+void context::update(const std::byte *data, size_t size)
+{   // O(N)
+	auto buffer_size = (size_t)(_size % _buffer.size());
+	_size += size;
+	if (buffer_size > 0) {  // complete the partial block first
+		const auto byte_count = std::min(size, _buffer.size() - buffer_size);
+		std::memcpy(_buffer.data() + buffer_size, data, byte_count);
+		data += byte_count;
+		size -= byte_count;
+		buffer_size += byte_count;
+		if (buffer_size < _buffer.size())
+			return;
+
+		_transform(_buffer.data());
+	}
+
+	for (; size >= _buffer.size(); data += _buffer.size(), size -= _buffer.size())
+		_transform(data);
+	std::memcpy(_buffer.data(), data, size);
+}
+
+
+digest_type context::digest()
+{
+	const auto bit_size = _size * 8;
+	const auto buffer_size = (size_t)(_size % _buffer.size());
+	std::byte padding[sizeof(_buffer) + 8]{std::byte{0x80}};
+	const auto padding_size = ((buffer_size < 56) ? 56 : 120) - buffer_size;
+	for (uint8_t i = 0; i < 8; ++i)
+		padding[padding_size + i] = (std::byte)(bit_size >> (8 * i));
+	update(padding, padding_size + 8);
+
+	digest_type res;
+	for (size_t i = 0; i < res.size(); ++i)
+		res[i] = (uint8_t)(_state[i / 4] >> (8 * (i % 4)));
+
+	_state = _initial_state;
+	_size = 0;
+
+	return res;
+}
+
+
+void context::_transform(const std::byte *block)
+{   // O(1)
+	uint32_t words[16];
+	std::memcpy(words, block, sizeof(words));
+	if constexpr (std::endian::native == std::endian::big)
+		for (auto &word: words)
+			word = std::byteswap(word);
+
+	auto [a, b, c, d] = _state;
+	for (uint8_t i = 0; i < 64; ++i) {
+		uint32_t f;
+		uint8_t word_idx;
+		switch (i / 16) {
+		case 0:  f = (b & c) | (~b & d); word_idx = i;                 break;
+		case 1:  f = (d & b) | (~d & c); word_idx = (5 * i + 1) % 16;  break;
+		case 2:  f = b ^ c ^ d;          word_idx = (3 * i + 5) % 16;  break;
+		default: f = c ^ (b | ~d);       word_idx = (7 * i) % 16;      break;
+		}
+
+		const auto rotated = std::rotl(a + f + _sines[i] + words[word_idx], _shifts[i / 16][i % 4]);
+		a = d;
+		d = c;
+		c = b;
+		b += rotated;
+	}
+
+	_state[0] += a;
+	_state[1] += b;
+	_state[2] += c;
+	_state[3] += d;
+}
+
+
+pipeline::pipeline()
+	: _context{}, _pool{1}, _jobs{}, _buffer{}
+{
+}
+
+
+std::span<std::byte> pipeline::buffer(size_t size)
+{
+	if (_jobs.size() >= _max_job_count) {  // waits for the oldest buffer, and reuses it
+		_buffer = _jobs.front().get();
+		_jobs.pop_front();
+	}
+	_buffer.resize(size);
+
+	return _buffer;
+}
+
+
+void pipeline::submit()
+{
+	_jobs.push_back(_pool.submit([this, data = std::move(_buffer)]() mutable {
+		_context.update(data.data(), data.size());
+
+		return std::move(data);
+	}));
+	_buffer.clear();
+}
+
+
+digest_type pipeline::digest()
+{
+	for (; !_jobs.empty(); _jobs.pop_front())
+		_jobs.front().get();
+
+	return _context.digest();
+}
+
+
+} // namespace md5
+} // namespace audio
@@ -0,0 +1,81 @@
+/* Copyright (C) 2024  Bogdan-Gabriel Alecu  (GameInstance.com)
+ *
+ * audio - C++ audio codecs.
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <basics/error.hh>
+#include "memory.hh"
+
+
+namespace audio {
+namespace memory {
+
+
+static constexpr const char *_mapped_input_name = "audio::memory::mapped_input";
+
+
+mapped_input::mapped_input(const char *path)
+	: input{_map(path)}
+{
+}
+
+
+mapped_input::~mapped_input()
+{
+	if (size() > 0)
+		::munmap((void *)data().data(), size());
+}
+
+
+std::span<const std::byte> mapped_input::_map(const char *path)
+{
+	const auto fd = ::open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		throw basics::error{"%s: (system error) cannot open %s (%s)", _mapped_input_name, path,
+																				std::strerror(errno)};
+
+	struct stat info;
+	if (::fstat(fd, &info) != 0) {
+		const auto error_code = errno;
+		::close(fd);
+		throw basics::error{"%s: (system error) cannot stat %s (%s)", _mapped_input_name, path,
+																			std::strerror(error_code)};
+	}
+
+	const auto size = (size_t)info.st_size;
+	if (size == 0) {  // cannot map an empty file
+		::close(fd);
+
+		return {};
+	}
+
+	auto *data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	const auto error_code = errno;
+	::close(fd);  // the mapping holds its own reference
+	if (data == MAP_FAILED)
+		throw basics::error{"%s: (system error) cannot map %s (%s)", _mapped_input_name, path,
+																			std::strerror(error_code)};
+
+	return {(const std::byte *)data, size};
+}
+
+
+} // namespace memory
+} // namespace audio
@@ -0,0 +1,66 @@
+/* Copyright (C) 2024  Bogdan-Gabriel Alecu  (GameInstance.com)
+ *
+ * audio - C++ audio codecs.
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "pool.hh"
+
+
+namespace audio {
+
+
+thread_pool::thread_pool(size_t thread_count)
+	: _is_stopping{false}
+{
+	if (thread_count == 0)
+		thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+
+	_threads.reserve(thread_count);
+	for (size_t i = 0; i < thread_count; ++i)
+		_threads.emplace_back(&thread_pool::_work, this);
+}
+
+
+thread_pool::~thread_pool()
+{
+	{
+		std::lock_guard lock{_mutex};
+		_is_stopping = true;
+	}
+	_condition.notify_all();
+
+	for (auto &thread: _threads)
+		thread.join();
+}
+
+
+void thread_pool::_work()
+{
+	for (;;) {
+		std::function<void()> job;
+		{
+			std::unique_lock lock{_mutex};
+			_condition.wait(lock, [this]() { return _is_stopping || !_jobs.empty(); });
+			if (_jobs.empty())
+				return;
+
+			job = std::move(_jobs.front());
+			_jobs.pop_front();
+		}
+		job();
+	}
+}
+
+
+} // namespace audio
@@ -0,0 +1,594 @@
+/* Copyright (C) 2024  Bogdan-Gabriel Alecu  (GameInstance.com)
+ *
+ * FLAC decoder - part of audio package
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program.
+ * If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <numbers>
+#include <span>
+#include <vector>
+#include <basics/error.hh>
+#include "buffer.hh"
+#include "crc.hh"
+#include "flac.hh"
+#include "md5.hh"
+#include "memory.hh"
+#include "pcm.hh"
+#include "wave.hh"
+
+using namespace basics;
+using namespace audio;
+
+
+/*******************************************************************************************************
+ *
+ * Regression tests on synthetic streams: each case builds a stream with flac::encoder, splices crafted
+ * frames into it where needed, and throws an error naming the failed check. Crafted frames hold
+ * 16-bit stereo CONSTANT subframes with valid CRCs, so that only the coded block size sets them apart
+ * from the real frames. Round-trip cases decode the stream back through one feature each, e.g. seek(),
+ * read() or the parallel_decoder, and check that the samples match the encoded signal.
+ *
+ */
+
+
+struct byte_ostream {  // output stream into memory
+	std::vector<std::byte> data;
+
+	void put(char value) { data.push_back((std::byte)value); }
+	void write(const char *values, size_t size)
+	{
+		data.insert(data.end(), (const std::byte *)values, (const std::byte *)values + size);
+	}
+	void flush() {}
+};
+
+
+static const size_t max_block_size = 4096;
+static const size_t sample_count = 4 * max_block_size;
+static const size_t md5_signature_offset = 4 + 4 + 18;  // marker, block header, STREAMINFO fields
+
+
+std::vector<int32_t> make_signal();
+std::vector<std::byte> make_stream(uint16_t block_size = max_block_size, size_t thread_count = 0);
+std::vector<std::byte> make_frame(uint32_t block_size);
+void check(bool condition, const char *name, const char *what);
+template<typename DECODER>
+void read_metadata(DECODER &decoder);
+template<typename DECODER>
+std::vector<int32_t> decode(DECODER &decoder, const char *name);
+void test_oversized_frame();
+void test_stream_resync();
+void test_interleaved_retry();
+void test_threaded_encoder();
+void test_seek();
+void test_frame_index();
+void test_crc_mismatch();
+void test_md5_verification();
+void test_parallel_decoder();
+void test_read();
+void test_wave_round_trip();
+
+
+int main()
+{
+	try {
+		test_oversized_frame();
+		test_stream_resync();
+		test_interleaved_retry();
+		test_threaded_encoder();
+		test_seek();
+		test_frame_index();
+		test_crc_mismatch();
+		test_md5_verification();
+		test_parallel_decoder();
+		test_read();
+		test_wave_round_trip();
+	} catch (const error &err) {
+		err.dump();
+
+		return 1;
+	}
+
+	return 0;
+}
+
+
+std::vector<int32_t> make_signal()
+{   // planar, sample_count apart: a tone per channel
+	auto res = std::vector<int32_t>(2 * sample_count);
+	for (size_t i = 0; i < sample_count; ++i) {
+		const auto t = 2 * std::numbers::pi * i / 44100.0;
+		res[i] = (int32_t)std::lround(8000 * std::sin(440.0 * t));
+		res[sample_count + i] = (int32_t)std::lround(8000 * std::sin(660.0 * t));
+	}
+
+	return res;
+}
+
+
+std::vector<std::byte> make_stream(uint16_t block_size, size_t thread_count)
+{   // make_signal() as 16-bit stereo at 44.1 kHz in block_size blocks, with its MD5 signature
+	const auto signal = make_signal();
+	auto ostream = byte_ostream{};
+	auto streaminfo = flac::streaminfo_type{};
+	streaminfo.max_block_size = block_size;
+	streaminfo.sample_rate = 44100;
+	streaminfo.channel_count = 2;
+	streaminfo.sample_bit_size = 16;
+
+	auto encoder = flac::encoder{ostream, streaminfo, thread_count};
+	encoder.encode_marker();
+	encoder.encode_metadata();
+	const auto planar = sample_view<const int32_t>{signal.data(), sample_count, 2, sample_count};
+	encoder.encode_audio(planar, sample_count);
+	encoder.finish();
+
+	// the encoder leaves the signature unset, as it can't rewind ostream
+	auto pcm_data = std::vector<std::byte>(2 * sample_count * sizeof(int16_t));
+	pcm::pack(pcm_data.data(), planar, sample_count, pcm::format::int16);
+	auto md5 = md5::context{};
+	md5.update(pcm_data.data(), pcm_data.size());
+	const auto digest = md5.digest();
+	std::memcpy(ostream.data.data() + md5_signature_offset, digest.data(), digest.size());
+
+	return ostream.data;
+}
+
+
+std::vector<std::byte> make_frame(uint32_t block_size)
+{   // a fixed blocking frame numbered 0, 16-bit stereo at 44.1 kHz, of two CONSTANT subframes
+	auto block_size_bitset = uint8_t{7};
+	for (uint8_t i = 0; i < 8; ++i)
+		if (block_size == (256u << i))
+			block_size_bitset = 8 + i;
+
+	const auto rate_bitset = uint8_t{9};             // 44.1 kHz
+	const auto channel_bitset = uint8_t{1};          // left/right stereo
+	const auto sample_bit_size_bitset = uint8_t{4};  // 16-bit
+	auto res = std::vector<std::byte>{std::byte{0xFF}, std::byte{0xF8}};
+	res.push_back((std::byte)((block_size_bitset << 4) | rate_bitset));
+	res.push_back((std::byte)((channel_bitset << 4) | (sample_bit_size_bitset << 1)));
+	res.push_back(std::byte{0});  // frame number
+	if (block_size_bitset == 7) {
+		res.push_back((std::byte)((block_size - 1) >> 8));
+		res.push_back((std::byte)(block_size - 1));
+	}
+	res.push_back((std::byte)crc::crc8(res.data(), res.size()));
+
+	for (auto value: {std::byte{0x12}, std::byte{0x34}}) {
+		res.push_back(std::byte{0});  // CONSTANT, no wasted bits
+		res.push_back(value);
+		res.push_back(value);
+	}
+
+	const auto crc = crc::crc16(res.data(), res.size());
+	res.push_back((std::byte)(crc >> 8));
+	res.push_back((std::byte)crc);
+
+	return res;
+}
+
+
+void check(bool condition, const char *name, const char *what)
+{
+	if (!condition)
+		throw error{"%s: (test failed) %s", name, what};
+}
+
+
+template<typename DECODER>
+void read_metadata(DECODER &decoder)
+{
+	decoder.decode_marker();
+	while (decoder.state() != flac::decoder_state::has_metadata)
+		decoder.decode_metadata();
+}
+
+
+template<typename DECODER>
+std::vector<int32_t> decode(DECODER &decoder, const char *name)
+{   // planar, sample_count apart as make_signal() has it, from the next block to the end
+	auto res = std::vector<int32_t>(2 * sample_count);
+	size_t offset{0};
+	for (decoder.decode_audio(); decoder.state() != flac::decoder_state::complete;
+																			decoder.decode_audio()) {
+		const auto block_size = decoder.block_size();
+		check(offset + block_size <= sample_count, name, "too many samples");
+		for (uint8_t channel_idx = 0; channel_idx < 2; ++channel_idx)
+			std::copy_n(decoder.block_data()[channel_idx].begin(), block_size,
+											res.begin() + channel_idx * sample_count + offset);
+		offset += block_size;
+	}
+	check(offset == sample_count, name, "too few samples");
+
+	return res;
+}
+
+
+void test_oversized_frame()
+{   // frames past the decoder buffer or the STREAMINFO maximum are rejected, never decoded
+	const auto stream = make_stream();
+	const auto audio_offset = flac::probe(stream).audio_offset;
+	check(audio_offset > 0, "oversized frame", "no audio in the encoded stream");
+
+	// past BUFFER_SIZE, and past the STREAMINFO maximum but within BUFFER_SIZE
+	for (uint32_t block_size: {32768u, 65536u, (uint32_t)max_block_size + 1}) {
+		auto data = std::vector<std::byte>{stream.begin(), stream.begin() + audio_offset};
+		const auto frame = make_frame(block_size);
+		data.insert(data.end(), frame.begin(), frame.end());
+
+		const auto streaminfo = flac::probe(data).streaminfo;
+		check(flac::find_frame(data, audio_offset, streaminfo) == data.size(), "oversized frame",
+														"header accepted by find_frame()");
+
+		auto istream = memory::input{data};
+		auto decoder = flac::decoder{istream};
+		decoder.decode_marker();
+		while (decoder.state() != flac::decoder_state::has_metadata)
+			decoder.decode_metadata();
+		auto is_rejected = false;
+		try {
+			decoder.decode_audio();
+		} catch (const error &) {
+			is_rejected = true;
+		}
+		check(is_rejected, "oversized frame", "frame decoded");
+	}
+
+	printf("%-44s ok\n", "oversized frame");
+}
+
+
+void test_stream_resync()
+{   // flac::stream_decoder skips an oversized frame between two real ones and decodes all of the others
+	const auto stream = make_stream();
+	const auto streaminfo = flac::probe(stream).streaminfo;
+	const auto audio_offset = flac::probe(stream).audio_offset;
+	const auto second_offset = flac::find_frame(stream, audio_offset + 1, streaminfo);
+	check(second_offset < stream.size(), "stream resync", "no second frame in the encoded stream");
+
+	const auto frame = make_frame(32768);
+	auto data = std::vector<std::byte>{stream.begin(), stream.begin() + second_offset};
+	data.insert(data.end(), frame.begin(), frame.end());
+	data.insert(data.end(), stream.begin() + second_offset, stream.end());
+
+	for (size_t piece_size: {size_t{1}, size_t{7}, size_t{1500}, data.size()}) {
+		auto decoder = flac::stream_decoder{};
+		size_t offset{0};
+		uint64_t decoded_count{0};
+		for (auto status = decoder.try_decode(); status != flac::feed_status::complete;
+																status = decoder.try_decode()) {
+			if (status == flac::feed_status::has_block) {
+				check(decoder.block_sample_number() == decoded_count, "stream resync",
+																"block out of order");
+				decoded_count += decoder.block_size();
+			} else if ((status == flac::feed_status::need_data) && (offset == data.size()))
+				decoder.finish();
+			else if (status == flac::feed_status::need_data) {
+				const auto size = std::min(piece_size, data.size() - offset);
+				decoder.feed(std::span{data}.subspan(offset, size));
+				offset += size;
+			}
+		}
+		check(decoded_count == sample_count, "stream resync", "blocks lost");
+		check(decoder.skipped_byte_count() == frame.size(), "stream resync",
+																"unexpected skipped byte count");
+	}
+
+	printf("%-44s ok\n", "stream resync");
+}
+
+
+void test_interleaved_retry()
+{   // decode_audio_interleaved() into too short an out throws and keeps the block for a larger one
+	const auto signal = make_signal();
+	const auto stream = make_stream();
+	auto istream = memory::input{stream};
+	auto decoder = flac::decoder{istream};
+	decoder.decode_marker();
+	while (decoder.state() != flac::decoder_state::has_metadata)
+		decoder.decode_metadata();
+	decoder.set_md5_verification(true);  // each block is hashed once, or the digest won't match
+
+	auto out = std::vector<int16_t>(2 * max_block_size);
+	const auto bytes = std::as_writable_bytes(std::span{out});
+	size_t decoded_count{0};
+	for (;;) {
+		auto is_rejected = false;
+		try {
+			decoder.decode_audio_interleaved(bytes.first(2), pcm::format::int16);
+		} catch (const error &) {
+			is_rejected = true;
+		}
+		if (decoder.state() == flac::decoder_state::complete)
+			break;
+		check(is_rejected, "interleaved retry", "short output accepted");
+
+		decoder.decode_audio_interleaved(bytes, pcm::format::int16);
+		for (size_t i = 0; i < decoder.block_size(); ++i)
+			check((out[2 * i] == signal[decoded_count + i]) &&
+						(out[2 * i + 1] == signal[sample_count + decoded_count + i]),
+																"interleaved retry", "block lost");
+		decoded_count += decoder.block_size();
+	}
+	check(decoded_count == sample_count, "interleaved retry", "blocks lost");
+
+	printf("%-44s ok\n", "interleaved retry");
+}
+
+
+void test_threaded_encoder()
+{   // frames encoded on a thread pool are written in order, as the single-threaded encoder has them
+	const auto signal = make_signal();
+	const auto stream = make_stream(max_block_size, 1);
+	for (size_t thread_count: {2, 4})
+		check(make_stream(max_block_size, thread_count) == stream, "threaded encoder",
+																"stream differs from one thread");
+
+	for (uint16_t block_size: {192, 1152}) {
+		const auto threaded_stream = make_stream(block_size, 4);
+		auto istream = memory::input{threaded_stream};
+		auto decoder = flac::decoder{istream};
+		read_metadata(decoder);
+		decoder.set_verification(true);
+		decoder.set_md5_verification(true);
+		check(decode(decoder, "threaded encoder") == signal, "threaded encoder", "samples differ");
+	}
+
+	printf("%-44s ok\n", "threaded encoder");
+}
+
+
+void test_seek()
+{   // the block after seek() starts at the target sample, within and across frames
+	const auto signal = make_signal();
+	const auto stream = make_stream(1152);
+	auto istream = memory::input{stream};
+	auto decoder = flac::decoder{istream};
+	read_metadata(decoder);
+
+	// within the first frame, on frame boundaries, backwards and at either end
+	const uint64_t samples[] = {0, 1, 1151, 1152, 5000, 3, sample_count - 1, 0};
+	for (auto sample: samples) {
+		decoder.seek(sample);
+		decoder.decode_audio();
+		check(decoder.state() != flac::decoder_state::complete, "seek", "stream ended");
+		check(decoder.block_sample_number() + decoder.block_size() <= sample_count, "seek",
+																		"block past the end");
+		const auto block = decoder.block_data();
+		for (size_t i = 0; i < decoder.block_size(); ++i)
+			check((block[0][i] == signal[sample + i]) &&
+						(block[1][i] == signal[sample_count + sample + i]), "seek",
+																				"block off the target");
+	}
+
+	printf("%-44s ok\n", "seek");
+}
+
+
+void test_frame_index()
+{   // a saved index loads back to the same frames, and seeks through them
+	const auto signal = make_signal();
+	const auto stream = make_stream(1152);
+	auto istream = memory::input{stream};
+	auto decoder = flac::decoder{istream};
+	read_metadata(decoder);
+	const auto index = flac::frame_index::build(decoder);
+	check(index.size() == (sample_count + 1151) / 1152, "frame index", "unexpected frame count");
+
+	const auto serialized = index.serialize();
+	const auto blob = std::vector<std::byte>{serialized.begin(), serialized.end()};
+	const auto loaded = flac::frame_index::load(blob);
+	check(loaded.size() == index.size(), "frame index", "unexpected loaded frame count");
+	uint64_t sample_number{0};
+	for (size_t i = 0; i < loaded.size(); ++i) {
+		check((loaded[i].byte_offset == index[i].byte_offset) &&
+					(loaded[i].sample_number == sample_number) &&
+					(loaded[i].sample_count == index[i].sample_count), "frame index", "frame differs");
+		sample_number += loaded[i].sample_count;
+	}
+	check(sample_number == sample_count, "frame index", "frames don't cover the stream");
+
+	auto seek_istream = memory::input{stream};
+	auto seek_decoder = flac::decoder{seek_istream};
+	read_metadata(seek_decoder);
+	const uint64_t samples[] = {5000, 0, 1152, sample_count - 1};
+	for (auto sample: samples) {
+		seek_decoder.seek(sample, loaded);
+		seek_decoder.decode_audio();
+		check(seek_decoder.block_data()[0][0] == signal[sample], "frame index",
+																	"seek off the target");
+	}
+
+	auto is_rejected = false;
+	try {
+		flac::frame_index::load(std::span{blob}.first(blob.size() - 1));
+	} catch (const error &) {
+		is_rejected = true;
+	}
+	check(is_rejected, "frame index", "truncated blob loaded");
+
+	printf("%-44s ok\n", "frame index");
+}
+
+
+void test_crc_mismatch()
+{   // a corrupt frame is rejected with verification on; a corrupt CRC-16 alone passes with it off
+	const auto signal = make_signal();
+	const auto stream = make_stream();
+	const auto audio_offset = flac::probe(stream).audio_offset;
+
+	// the last byte is the CRC-16 of the last frame; the others corrupt the samples of the first one
+	for (size_t offset: {stream.size() - 1, audio_offset + 100, (audio_offset + stream.size()) / 2}) {
+		auto data = stream;
+		data[offset] ^= std::byte{0x10};
+
+		auto istream = memory::input{data};
+		auto decoder = flac::decoder{istream};
+		read_metadata(decoder);
+		decoder.set_verification(true);
+		auto is_rejected = false;
+		try {
+			decode(decoder, "crc mismatch");
+		} catch (const error &) {
+			is_rejected = true;
+		}
+		check(is_rejected, "crc mismatch", "corrupt frame accepted");
+	}
+
+	auto data = stream;
+	data.back() ^= std::byte{0x10};
+	auto istream = memory::input{data};
+	auto decoder = flac::decoder{istream};
+	read_metadata(decoder);
+	check(decode(decoder, "crc mismatch") == signal, "crc mismatch", "samples differ");
+
+	printf("%-44s ok\n", "crc mismatch");
+}
+
+
+void test_md5_verification()
+{   // the digest of the decoded samples is checked on reaching the end, by both decoders
+	const auto stream = make_stream(1152);
+	for (auto is_corrupt: {false, true}) {
+		auto data = stream;
+		if (is_corrupt)
+			data[md5_signature_offset] ^= std::byte{1};
+
+		auto is_rejected = false;
+		try {
+			auto istream = memory::input{data};
+			auto decoder = flac::decoder{istream};
+			read_metadata(decoder);
+			decoder.set_md5_verification(true);
+			decode(decoder, "md5 verification");
+		} catch (const error &) {
+			is_rejected = true;
+		}
+		check(is_rejected == is_corrupt, "md5 verification", "unexpected decoder result");
+
+		is_rejected = false;
+		try {
+			auto decoder = flac::parallel_decoder<>{data, 2, 2048};
+			read_metadata(decoder);
+			decoder.set_md5_verification(true);
+			decode(decoder, "md5 verification");
+		} catch (const error &) {
+			is_rejected = true;
+		}
+		check(is_rejected == is_corrupt, "md5 verification", "unexpected parallel_decoder result");
+	}
+
+	printf("%-44s ok\n", "md5 verification");
+}
+
+
+void test_parallel_decoder()
+{   // chunks decoded ahead return the blocks of sequential decoding, in order
+	const auto stream = make_stream(256);
+	auto istream = memory::input{stream};
+	auto sequential_decoder = flac::decoder{istream};
+	read_metadata(sequential_decoder);
+	const auto samples = decode(sequential_decoder, "parallel decoder");
+	check(samples == make_signal(), "parallel decoder", "sequential samples differ");
+
+	for (size_t thread_count: {1, 3}) {
+		for (size_t chunk_byte_size: {size_t{1000}, size_t{4096}, flac::default_chunk_byte_size}) {
+			auto decoder = flac::parallel_decoder<>{stream, thread_count, chunk_byte_size};
+			read_metadata(decoder);
+			decoder.set_verification(true);
+			check(decode(decoder, "parallel decoder") == samples, "parallel decoder",
+																		"samples differ");
+		}
+	}
+
+	auto index_istream = memory::input{stream};
+	auto index_decoder = flac::decoder{index_istream};
+	read_metadata(index_decoder);
+	const auto index = flac::frame_index::build(index_decoder);
+	auto decoder = flac::parallel_decoder<>{stream, index, 3, 1000};
+	read_metadata(decoder);
+	check(decode(decoder, "parallel decoder") == samples, "parallel decoder",
+																"samples differ with an index");
+
+	printf("%-44s ok\n", "parallel decoder");
+}
+
+
+void test_read()
+{   // read() hands out every sample in order, whatever the request size vs. the block size
+	const auto signal = make_signal();
+	const auto stream = make_stream(1152);
+	for (size_t frame_count: {size_t{1}, size_t{7}, size_t{1152}, size_t{5000}}) {
+		auto istream = memory::input{stream};
+		auto decoder = flac::decoder{istream};
+		read_metadata(decoder);
+
+		auto out = std::vector<int32_t>(2 * frame_count);
+		size_t offset{0};
+		for (auto count = decoder.read(out, frame_count); count > 0;
+															count = decoder.read(out, frame_count)) {
+			check((offset + count <= sample_count) && ((count == frame_count) ||
+						(offset + count == sample_count)), "read", "unexpected sample count");
+			for (size_t i = 0; i < count; ++i)
+				check((out[2 * i] == signal[offset + i]) &&
+							(out[2 * i + 1] == signal[sample_count + offset + i]), "read",
+																					"samples differ");
+			offset += count;
+		}
+		check(offset == sample_count, "read", "samples lost");
+		check(decoder.state() == flac::decoder_state::complete, "read", "stream not complete");
+	}
+
+	printf("%-44s ok\n", "read");
+}
+
+
+void test_wave_round_trip()
+{   // wave::decoder returns the samples wave::encoder wrote, in every integer container size
+	const auto signal = make_signal();
+	const auto planar = sample_view<const int32_t>{signal.data(), sample_count, 2, sample_count};
+	for (uint8_t sample_bit_size: {16, 24, 32}) {
+		auto ostream = byte_ostream{};
+		auto encoder = wave::encoder{ostream};
+		encoder.encode_header(wave::streaminfo_type{44100, sample_bit_size, 2, sample_count});
+		encoder.encode_block(planar, sample_count);
+		encoder.finish();
+
+		auto istream = memory::input{ostream.data};
+		auto decoder = wave::decoder{istream};
+		decoder.decode_header();
+		check((decoder.streaminfo().sample_count == sample_count) &&
+					(decoder.streaminfo().sample_bit_size == sample_bit_size), "wave round trip",
+																		"unexpected streaminfo");
+		size_t offset{0};
+		for (decoder.decode_audio(); decoder.state() != wave::decoder_state::complete;
+																			decoder.decode_audio()) {
+			const auto block = decoder.block_data();
+			check(offset + decoder.block_size() <= sample_count, "wave round trip", "too many samples");
+			for (size_t i = 0; i < decoder.block_size(); ++i)
+				check((block[0][i] == signal[offset + i]) &&
+							(block[1][i] == signal[sample_count + offset + i]), "wave round trip",
+																			"samples differ");
+			offset += decoder.block_size();
+		}
+		check(offset == sample_count, "wave round trip", "samples lost");
+	}
+
+	printf("%-44s ok\n", "wave round trip");
+}
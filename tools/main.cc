@@ -14,50 +14,99 @@
  * If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
 #include <basics/error.hh>
 #include <basics/file.hh>
+#include "buffer.hh"
 #include "flac.hh"
+#include "memory.hh"
+#include "pcm.hh"
+#include "pool.hh"
+#include "ring.hh"
 #include "wave.hh"
 
 using namespace basics;
 using namespace audio;
 
 
-void print_info(const flac::streaminfo_type &/*info*/);
+static constexpr size_t pipeline_block_count = 8;  // decoded ahead of the writer
 
+// batch workers keep one decoder each, reset onto every file they transcode
+using flac_decoder_type = flac::decoder<memory::mapped_input, 8192, flac::buffer_sample_type,
+	flac::max_channel_count, flac::no_instrumentation, pooled_allocator<flac::buffer_sample_type>>;
 
-int main(int argc, char *argv[])
-{
-	try {
-		if (argc < 3)
-			throw error{"Usage: %s <input.flac> <output.wav>", argv[0]};
 
-		auto file_istream = file::input{argv[1]};
-		auto flac_istream = flac::decoder{file_istream};
-		auto file_ostream = file::output{argv[2], true};
-		auto wave_ostream = wave::encoder{file_ostream};
+struct transcode_type {
+	uint64_t sample_count;    // per channel
+	uint32_t sample_rate;
+	size_t input_byte_size;
+	size_t output_byte_size;
+	uint64_t off_rate_sample_count;  // in blocks at another sample rate than the stream's
+};
 
-		flac_istream.decode_marker();
-		while (flac_istream.state() != flac::decoder_state::has_metadata)
-			flac_istream.decode_metadata();
 
-		auto info = flac_istream.streaminfo();
-		print_info(info);
-		wave_ostream.encode_header(wave::streaminfo_type{info.sample_rate, info.sample_bit_size,
-															   info.channel_count, info.sample_count});
+struct pcm_block_type {
+	std::vector<std::byte> data;
+	size_t byte_size;
+};
 
-		while (flac_istream.state() != flac::decoder_state::complete) {
-			flac_istream.decode_audio();
-			if (flac_istream.block_sample_rate() != info.sample_rate)
-				throw error{"variable sample rate not supported"};
 
-			for (auto i = size_t{0}; i < flac_istream.block_size(); ++i)
-				for (auto channel_idx = uint8_t{0}; channel_idx < info.channel_count; ++channel_idx)
-					wave_ostream.encode_sample(flac_istream.block_data()[channel_idx][i]);
+transcode_type transcode(const char *input_path, const char *output_path,
+			std::optional<flac_decoder_type> &decoder, std::vector<std::byte> &block, bool is_verbose);
+transcode_type transcode_pipelined(const char *input_path, const char *output_path, bool is_verbose);
+transcode_type start_transcode(flac_decoder_type &flac_istream,
+					wave::encoder<file::output> &wave_ostream, size_t input_byte_size, bool is_verbose);
+size_t transcode_block(flac_decoder_type &flac_istream, std::vector<std::byte> &block,
+																				transcode_type &res);
+bool is_flac_file(const char *path);
+std::string output_file_path(const char *output_dir, const std::string &input_path);
+std::vector<std::string> list_inputs(const char *path);
+int run_batch(const char *input_path, const char *output_path, size_t thread_count);
+void print_info(const flac::streaminfo_type &/*info*/);
+void print_off_rate(const char *input_path, const transcode_type &res);
+
+
+int main(int argc, char *argv[])
+{
+	try {
+		size_t thread_count{0};
+		int arg_idx{1};
+		if ((argc > 2) && (std::strcmp(argv[1], "-j") == 0)) {
+			thread_count = std::strtoul(argv[2], nullptr, 10);
+			arg_idx += 2;
 		}
+		if (argc - arg_idx != 2)
+			throw error{"Usage: %s <input.flac> <output.wav|output_dir>\n"
+						"       %s [-j <thread_count>] <input_dir|manifest> <output_dir>",
+																				argv[0], argv[0]};
+
+		const auto *input_path = argv[arg_idx];
+		const auto *output_path = argv[arg_idx + 1];
+		if (!std::filesystem::is_directory(output_path))
+			transcode_pipelined(input_path, output_path, true);
+		else if (is_flac_file(input_path))  // into output_dir/<stem>.wav
+			transcode_pipelined(input_path, output_file_path(output_path, input_path).c_str(), true);
+		else
+			return run_batch(input_path, output_path, thread_count);
 	} catch (const error &err) {
 		err.dump();
 
+		return 1;
+	} catch (const std::filesystem::filesystem_error &err) {
+		error{"%s", err.what()}.dump();
+
 		return 1;
 	}
 
@@ -65,6 +114,217 @@ int main(int argc, char *argv[])
 }
 
 
+transcode_type transcode(const char *input_path, const char *output_path,
+			std::optional<flac_decoder_type> &decoder, std::vector<std::byte> &block, bool is_verbose)
+{   // reuses decoder and block across calls
+	auto file_istream = memory::mapped_input{input_path};
+	if (decoder)
+		decoder->reset(file_istream);
+	else
+		decoder.emplace(file_istream);
+	auto &flac_istream = *decoder;
+	auto file_ostream = file::output{output_path, true};
+	auto wave_ostream = wave::encoder{file_ostream};
+
+	auto res = start_transcode(flac_istream, wave_ostream, file_istream.size(), is_verbose);
+	for (auto byte_size = transcode_block(flac_istream, block, res); byte_size > 0;
+												byte_size = transcode_block(flac_istream, block, res))
+		wave_ostream.encode_pcm({block.data(), byte_size});
+	wave_ostream.finish();
+	print_off_rate(input_path, res);
+
+	return res;
+}
+
+
+transcode_type transcode_pipelined(const char *input_path, const char *output_path, bool is_verbose)
+{   // decodes on the calling thread while a writer thread drains a ring of PCM blocks to the output
+	auto file_istream = memory::mapped_input{input_path};
+	auto flac_istream = flac_decoder_type{file_istream};
+	auto file_ostream = file::output{output_path, true};
+	auto wave_ostream = wave::encoder{file_ostream};
+
+	auto res = start_transcode(flac_istream, wave_ostream, file_istream.size(), is_verbose);
+	auto ring = spsc_ring<pcm_block_type>{pipeline_block_count};
+	auto writer_error = std::exception_ptr{};
+	auto writer = std::thread{[&ring, &wave_ostream, &writer_error]() {
+		try {
+			for (const auto *block = ring.front(); block != nullptr; block = ring.front()) {
+				wave_ostream.encode_pcm({block->data.data(), block->byte_size});
+				ring.pop();
+			}
+		} catch (...) {
+			writer_error = std::current_exception();
+			ring.close();
+		}
+	}};
+
+	try {
+		// no block to fill once the writer fails
+		for (auto *block = ring.back(); block != nullptr; block = ring.back()) {
+			block->byte_size = transcode_block(flac_istream, block->data, res);
+			if (block->byte_size == 0)
+				break;
+			ring.push();
+		}
+	} catch (...) {
+		ring.close();
+		writer.join();
+		throw;
+	}
+
+	ring.close();
+	writer.join();
+	if (writer_error)
+		std::rethrow_exception(writer_error);
+	wave_ostream.finish();
+	print_off_rate(input_path, res);
+
+	return res;
+}
+
+
+transcode_type start_transcode(flac_decoder_type &flac_istream,
+					wave::encoder<file::output> &wave_ostream, size_t input_byte_size, bool is_verbose)
+{   // decodes the metadata and writes the WAVE header; no samples transcoded yet
+	flac_istream.decode_marker();
+	while (flac_istream.state() != flac::decoder_state::has_metadata)
+		flac_istream.decode_metadata();
+
+	const auto &info = flac_istream.streaminfo();
+	if (is_verbose)
+		print_info(info);
+	wave_ostream.encode_header(wave::streaminfo_type{info.sample_rate, info.sample_bit_size,
+														   info.channel_count, info.sample_count});
+
+	return transcode_type{0, info.sample_rate, input_byte_size, 0, 0};
+}
+
+
+size_t transcode_block(flac_decoder_type &flac_istream, std::vector<std::byte> &block,
+																					transcode_type &res)
+{   // O(N); decodes the next block as PCM into block, grown to the largest block; 0 bytes once complete
+	const auto &info = flac_istream.streaminfo();
+	const auto format = (pcm::format)info.sample_bit_size;
+	const auto frame_byte_size = (size_t)info.channel_count * pcm::sample_byte_size(format);
+	if (block.size() < info.max_block_size * frame_byte_size)  // reused across blocks and files
+		block.resize(info.max_block_size * frame_byte_size);
+
+	flac_istream.decode_audio_interleaved(block, format);
+	if (flac_istream.state() == flac::decoder_state::complete)
+		return 0;
+	if (flac_istream.block_sample_rate() != info.sample_rate)  // WAVE has a single rate
+		res.off_rate_sample_count += flac_istream.block_size();
+
+	const auto byte_size = flac_istream.block_size() * frame_byte_size;
+	res.sample_count += flac_istream.block_size();
+	res.output_byte_size += byte_size;
+
+	return byte_size;
+}
+
+
+bool is_flac_file(const char *path)
+{   // a regular file starting with the FLAC marker, rather than a manifest
+	if (!std::filesystem::is_regular_file(path))
+		return false;
+
+	char marker[4]{};
+	auto istream = std::ifstream{path, std::ios::binary};
+	istream.read(marker, sizeof(marker));
+
+	return istream && (std::memcmp(marker, "fLaC", sizeof(marker)) == 0);
+}
+
+
+std::string output_file_path(const char *output_dir, const std::string &input_path)
+{   // output_dir/<stem>.wav
+	auto stem = std::filesystem::path{input_path}.stem();
+	return (std::filesystem::path{output_dir} / stem).string() + ".wav";
+}
+
+
+std::vector<std::string> list_inputs(const char *path)
+{   // the .flac files of a directory, or the lines of a manifest
+	auto res = std::vector<std::string>{};
+
+	if (std::filesystem::is_directory(path)) {
+		for (const auto &entry: std::filesystem::directory_iterator{path})
+			if (entry.is_regular_file() && (entry.path().extension() == ".flac"))
+				res.push_back(entry.path().string());
+		std::sort(res.begin(), res.end());
+	} else {
+		auto manifest = std::ifstream{path};
+		if (!manifest)
+			throw error{"cannot open manifest %s", path};
+		for (std::string line; std::getline(manifest, line);)
+			if (!line.empty())
+				res.push_back(line);
+	}
+
+	return res;
+}
+
+
+int run_batch(const char *input_path, const char *output_path, size_t thread_count)
+{
+	const auto inputs = list_inputs(input_path);
+	const auto start = std::chrono::steady_clock::now();
+
+	auto pool = thread_pool{thread_count};
+	auto jobs = std::vector<std::future<transcode_type>>{};
+	jobs.reserve(inputs.size());
+	for (const auto &input: inputs) {
+		auto output = output_file_path(output_path, input);
+		jobs.push_back(pool.submit([&input, output = std::move(output)]() {
+			thread_local auto decoder = std::optional<flac_decoder_type>{};  // one per worker
+			thread_local auto block = std::vector<std::byte>{};
+
+			return transcode(input.c_str(), output.c_str(), decoder, block, false);
+		}));
+	}
+
+	auto total = transcode_type{};
+	double audio_seconds{0};
+	size_t failed_count{0};
+	for (size_t i = 0; i < jobs.size(); ++i) {
+		try {
+			const auto res = jobs[i].get();
+			audio_seconds += (double)res.sample_count / res.sample_rate;
+			total.sample_count += res.sample_count;
+			total.input_byte_size += res.input_byte_size;
+			total.output_byte_size += res.output_byte_size;
+		} catch (const error &err) {
+			fprintf(stderr, "%s: ", inputs[i].c_str());
+			err.dump();
+			++failed_count;
+		}
+	}
+
+	const auto elapsed = std::chrono::steady_clock::now() - start;
+	const auto seconds = std::chrono::duration<double>(elapsed).count();
+	printf("Batch transcode:\n");
+	printf("* files=%zu (%zu failed)\n", inputs.size(), failed_count);
+	printf("* threads=%zu\n", pool.thread_count());
+	printf("* samples=%lu (%.1fs of audio)\n", total.sample_count, audio_seconds);
+	printf("* input=%.1fMB output=%.1fMB\n", total.input_byte_size / 1e6, total.output_byte_size / 1e6);
+	printf("* time=%.3fs\n", seconds);
+	printf("* throughput=%.1fMB/s (input), %.1f files/s, %.0fx realtime\n",
+						total.input_byte_size / 1e6 / seconds, (inputs.size() - failed_count) / seconds,
+																			audio_seconds / seconds);
+
+	return (failed_count > 0) ? 1 : 0;
+}
+
+
+void print_off_rate(const char *input_path, const transcode_type &res)
+{
+	if (res.off_rate_sample_count > 0)
+		fprintf(stderr, "%s: %lu samples in blocks at other sample rates, written at %u Hz\n",
+												input_path, res.off_rate_sample_count, res.sample_rate);
+}
+
+
 void print_info(const audio::flac::streaminfo_type &info)
 {
 	printf("FLAC stream info:\n");